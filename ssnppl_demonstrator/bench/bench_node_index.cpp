@@ -0,0 +1,148 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "node_index.hpp"
+#include "utils.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+/*  Nearest node lookup of the localized service against the node count of the tile:
+    the NodeIndex grid against the linear haversine scan of the node names it replaced.
+    Reports the time per lookup and the lookups where both disagree on the nearest node. */
+
+#define BENCH_QUERIES 20000
+#define BENCH_TILE_SPAN 2.5f // degrees covered by the nodes, like a PointPerfect tile
+
+static std::string node_name(float latitude, float longitude)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%c%04d%c%05d", latitude < 0 ? 'S' : 'N', (int)std::round(std::fabs(latitude) * 100),
+                  longitude < 0 ? 'W' : 'E', (int)std::round(std::fabs(longitude) * 100));
+    return name;
+}
+
+static void node_position(const std::string &node, float &latitude, float &longitude)
+{
+    latitude = std::stof(node.substr(1, 4)) / 100;
+    longitude = std::stof(node.substr(6, 5)) / 100;
+    if (node[0] == 'S')
+        latitude = -latitude;
+    if (node[5] == 'W')
+        longitude = -longitude;
+}
+
+// The lookup before NodeIndex: every node name parsed and compared for every position
+static int linear_nearest(const std::vector<std::string> &nodes, float latitude, float longitude)
+{
+    float minimum = std::numeric_limits<float>::max();
+    int nearest = -1;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        float node_latitude, node_longitude;
+        node_position(nodes[i], node_latitude, node_longitude);
+        float distance = distanceBetweenLocations(latitude, longitude, node_latitude, node_longitude);
+        if (distance < minimum)
+        {
+            minimum = distance;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+static void bench_nodes(size_t count, float base_latitude, std::mt19937 &random)
+{
+    // Square grid of nodes, positions inside and around the tile
+    std::vector<std::string> nodes;
+    int side = std::ceil(std::sqrt(count));
+    float step = BENCH_TILE_SPAN / side;
+    for (int i = 0; i < side; i++)
+        for (int j = 0; j < side && nodes.size() < count; j++)
+            nodes.push_back(node_name(base_latitude + i * step, -3.0f + j * step));
+    std::uniform_real_distribution<float> latitude(base_latitude - 0.5f, base_latitude + BENCH_TILE_SPAN + 0.5f);
+    std::uniform_real_distribution<float> longitude(-3.5f, -3.0f + BENCH_TILE_SPAN + 0.5f);
+    std::vector<std::pair<float, float>> positions(BENCH_QUERIES);
+    for (auto &position : positions)
+        position = std::make_pair(latitude(random), longitude(random));
+
+    NodeIndex index;
+    index.build(nodes);
+
+    // Ties between nodes at the same distance (float rounding) are reported with both distances
+    int mismatches = 0;
+    for (const auto &position : positions)
+    {
+        int fast = index.nearest(position.first, position.second);
+        int slow = linear_nearest(nodes, position.first, position.second);
+        if (fast == slow)
+            continue;
+        mismatches++;
+        float fast_latitude, fast_longitude, slow_latitude, slow_longitude;
+        node_position(nodes[fast], fast_latitude, fast_longitude);
+        node_position(nodes[slow], slow_latitude, slow_longitude);
+        std::printf("  %s %.6f km vs %s %.6f km\n",
+                    nodes[fast].c_str(), distanceBetweenLocations(position.first, position.second, fast_latitude, fast_longitude),
+                    nodes[slow].c_str(), distanceBetweenLocations(position.first, position.second, slow_latitude, slow_longitude));
+    }
+
+    long sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const auto &position : positions)
+        sink += index.nearest(position.first, position.second);
+    std::chrono::steady_clock::time_point indexed = std::chrono::steady_clock::now();
+    // The scan is slow on the large tiles, fewer lookups keep the run short
+    size_t scanned = count >= 1600 ? BENCH_QUERIES / 10 : BENCH_QUERIES;
+    for (size_t i = 0; i < scanned; i++)
+        sink += linear_nearest(nodes, positions[i].first, positions[i].second);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::printf("%5zu nodes lat %5.1f  NodeIndex %8.3f us/lookup  scan %9.3f us/lookup  mismatches %d/%d\n",
+                nodes.size(), base_latitude,
+                std::chrono::duration<double, std::micro>(indexed - start).count() / BENCH_QUERIES,
+                std::chrono::duration<double, std::micro>(end - indexed).count() / scanned,
+                mismatches, BENCH_QUERIES);
+    if (sink == 0)
+        std::printf("\n");
+}
+
+int main()
+{
+    std::mt19937 random(1);
+    for (size_t count : {10, 50, 100, 400, 1600, 6400})
+        for (float base_latitude : {47.5f, -33.0f, 70.0f})
+            bench_nodes(count, base_latitude, random);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "queue.hpp"
+#include "latency.hpp"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*  Hand-off of correction-sized messages from one producer thread to one consumer thread:
+    the SpscRing of reused slots against the std::mutex + std::queue of fresh vectors it replaced.
+    Reports the time per message and the hand-off latency (push to pop). */
+
+#define BENCH_MESSAGES 1000000
+#define BENCH_CAPACITY 64
+#define BENCH_PAYLOAD 1024
+
+struct Message {
+    std::vector<uint8_t> data;
+    latency_clock::time_point stamp;
+};
+
+static void report(const char *name, latency_clock::duration elapsed, const LatencyHistogram &latency)
+{
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / BENCH_MESSAGES;
+    std::printf("%-22s %8.1f ns/message  latency p50<=%lldus p99<=%lldus max=%lldus\n", name, ns,
+                (long long)latency.percentile(50), (long long)latency.percentile(99), (long long)latency.percentile(100));
+}
+
+static void bench_mutex_queue(const uint8_t *payload)
+{
+    std::mutex lock;
+    std::queue<Message> queue;
+    LatencyHistogram latency;
+
+    latency_clock::time_point start = latency_clock::now();
+    std::thread producer([&] {
+        for (int i = 0; i < BENCH_MESSAGES; i++)
+        {
+            Message message;
+            message.data.assign(payload, payload + 300 + i % (BENCH_PAYLOAD - 300));
+            message.stamp = latency_clock::now();
+            for (bool pushed = false; !pushed; )
+            {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (queue.size() < BENCH_CAPACITY)
+                    {
+                        queue.push(message);
+                        pushed = true;
+                    }
+                }
+                if (!pushed)
+                    std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t sink = 0;
+    for (int received = 0; received < BENCH_MESSAGES;)
+    {
+        Message message;
+        bool popped = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!queue.empty())
+            {
+                message = queue.front();
+                queue.pop();
+                popped = true;
+            }
+        }
+        if (!popped)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        latency.record_since(message.stamp);
+        sink += message.data.size();
+        received++;
+    }
+    producer.join();
+    report("mutex + std::queue", latency_clock::now() - start, latency);
+    if (sink == 0)
+        std::printf("\n");
+}
+
+static void bench_spsc_ring(const uint8_t *payload)
+{
+    SpscRing<Message> ring(BENCH_CAPACITY, RING_BLOCK, [](Message &slot) { slot.data.reserve(BENCH_PAYLOAD); });
+    LatencyHistogram latency;
+
+    latency_clock::time_point start = latency_clock::now();
+    std::thread producer([&] {
+        for (int i = 0; i < BENCH_MESSAGES; i++)
+        {
+            Message *slot = ring.begin_push();
+            slot->data.assign(payload, payload + 300 + i % (BENCH_PAYLOAD - 300));
+            slot->stamp = latency_clock::now();
+            ring.end_push();
+        }
+    });
+
+    uint64_t sink = 0;
+    for (int received = 0; received < BENCH_MESSAGES;)
+    {
+        Message *message = ring.pop();
+        if (message == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        latency.record_since(message->stamp);
+        sink += message->data.size();
+        received++;
+    }
+    producer.join();
+    report("SpscRing", latency_clock::now() - start, latency);
+    if (sink == 0)
+        std::printf("\n");
+}
+
+int main()
+{
+    std::vector<uint8_t> payload(BENCH_PAYLOAD);
+    std::memset(payload.data(), 0x73, payload.size());
+
+    std::printf("%d messages of 300 to %d bytes, capacity %d\n", BENCH_MESSAGES, BENCH_PAYLOAD, BENCH_CAPACITY);
+    bench_mutex_queue(payload.data());
+    bench_spsc_ring(payload.data());
+    return 0;
+}
@@ -42,6 +42,10 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <functional>
+#include <memory>
+#include <boost/asio/steady_timer.hpp>
+#include "transport.hpp"
 
 #define MAX_RCVR_DATA 10000
 
@@ -51,54 +55,85 @@
 class SerialPort
 {
 public:
-    void open_serial_port(std::string device_path, unsigned int baud_rate);
+    // Called from the io_service thread with the bytes of each completed asynchronous read
+    typedef std::function<void(const uint8_t *data, size_t size)> data_handler;
+
+    // Called after a lost connection is reopened and before the reading resumes, from the thread reading the port
+    typedef std::function<void()> reconnect_handler;
+
+    // Default Ctor uses a private io_service, otherwise the port is driven by a shared one
+    SerialPort() : io_service(own_io_service) {}
+    explicit SerialPort(boost::asio::io_service &shared_io_service) : io_service(shared_io_service) {}
+
+    // Both reopen a lost connection with a backoff, false if the first open fails
+    bool open_serial_port(std::string device_path, unsigned int baud_rate);
+    bool open_tcp_port(const std::string &host, const std::string &port);
+
+    void onReconnect(reconnect_handler handler) { on_reconnect = handler; }
+
+    // Receiver port name (IP10, USB1 ...) of this connection from the prompt, "" if not found in time
+    std::string identifyPort(std::chrono::milliseconds timeout);
 
     /*  The async_read_some and data_received functions are called in a loop,
         with the async_read_some function being called inside the data_received function and vice versa.
-        This creates a continuous cycle of reading data from the serial port and processing the received data.*/
+        This creates a continuous cycle of reading data from the serial port and processing the received data.
+        The io_service given to the Ctor must be run by the caller for the handler to be called.*/
 
     void close_serial_port(void);
 
-    void async_read_some(void);
-    size_t sync_read();
+    void async_read_some(data_handler handler);
+
+    // Blocking read straight into the caller's buffer, returns the bytes read (0 while disconnected)
+    size_t sync_read(uint8_t *data, size_t size);
 
     void sync_write(const std::string &data);
     void sync_write(const uint8_t *data, size_t size);
 
-    uint8_t *getSyncBuffer() { return read_sync_buffer; };
-
-    void clearSyncBuffer() { std::memset(read_sync_buffer, 0, MAX_RCVR_DATA); };
-
     void setCmdInputMode();
     void setDefaultConfig();
 
     std::string findUsedPort(const std::string &str);
 
-    bool isOpen() const { return serial_port->is_open(); };
+    bool isOpen() const { return transport && transport->is_open(); };
+
+    uint64_t reconnects() const { return reconnect_count; }
+    uint64_t writeDrops() const { return write_drops; }
 
-    // main buffer
-    std::string serial_read_data;
+    // Time from the read error to the reconnection, in us
+    uint64_t outageTotalUs() const { return outage_total_us; }
+    uint64_t outageMaxUs() const { return outage_max_us; }
 
-    std::atomic<bool> serial_data_read_complete{false};
     std::atomic<bool> used_port_found{false};
 
 private:
     void data_received(const boost::system::error_code &ec, size_t bytes_transferred);
 
+    void start_async_read();
+
+    // Reopens the transport after a backoff, from the io_service (event ingest) or the reader (poll ingest)
+    void schedule_reconnect();
+    bool try_reconnect();
+    void disconnected();
+
     boost::mutex mutex;
-    boost::asio::io_service io_service;
+    boost::asio::io_service own_io_service;
+    boost::asio::io_service &io_service;
     boost::system::error_code error;
 
-    typedef boost::shared_ptr<boost::asio::serial_port> serial_port_ptr;
-    serial_port_ptr serial_port;
-
-    std::vector<char> async_buffer_;
+    std::unique_ptr<Transport> transport;
+    std::atomic<bool> closing{false};
+    boost::asio::steady_timer reconnect_timer{io_service};
+    std::chrono::milliseconds backoff{TRANSPORT_BACKOFF_MIN};
+    std::atomic<uint64_t> reconnect_count{0};
+    std::atomic<uint64_t> write_drops{0};
+    std::chrono::steady_clock::time_point disconnected_at;
+    std::atomic<uint64_t> outage_total_us{0};
+    std::atomic<uint64_t> outage_max_us{0};
+    reconnect_handler on_reconnect;
 
     // Final read async buffer
-    char read_buffer[MAX_RCVR_DATA];
-
-    // Final read sync buffer
-    uint8_t read_sync_buffer[MAX_RCVR_DATA];
+    uint8_t read_buffer[MAX_RCVR_DATA];
+    data_handler on_data;
 };
 
 #endif
@@ -0,0 +1,110 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __COMMAND_ENGINE__
+#define __COMMAND_ENGINE__
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <iostream>
+#include <atomic>
+#include "latency.hpp"
+
+#define COMMAND_REPLY_TIMEOUT std::chrono::seconds(2)
+#define COMMAND_MODE_SETTLE std::chrono::seconds(1) // after "SSSS...", which gets no $R reply
+#define COMMAND_RETRIES 2                           // attempts again after a $R? reply or a timeout
+
+/*  Queue of Septentrio commands sent one at a time on the main channel. A command is complete
+    when the receiver answers with a $R line echoing its name ($R? is an error) or when its
+    timeout expires, errors and timeouts are retried COMMAND_RETRIES times.
+    Commands without reply (entering command mode with "SSSS...") just wait their settle time.
+
+    Threads: queue() from anywhere, on_reply() from the main channel reader, poll() from the
+    thread writing to the receiver, which keeps sending RTCM between two polls. */
+class CommandEngine {
+    public:
+        typedef std::function<void(const std::string &)> command_writer;
+        typedef std::function<void()> wakeup;
+        typedef std::function<void(bool)> command_done; // true when the receiver accepted it
+
+        CommandEngine(command_writer writer, wakeup wake) : writer(writer), wake(wake) {}
+
+        void queue(const std::string &command, command_done done = nullptr,
+                   latency_clock::duration timeout = COMMAND_REPLY_TIMEOUT);
+        void queue_without_reply(const std::string &command, latency_clock::duration settle);
+
+        void on_reply(const char *reply, size_t size);
+
+        // Completes and sends commands, returns when poll() is due again (time_point::max() when idle)
+        latency_clock::time_point poll();
+
+        // poll() has something to do right now
+        bool ready();
+
+        void print(std::ostream &os, const std::string &name) const;
+
+        uint64_t sent_count() const { return sent; }
+        uint64_t error_count() const { return errors; }
+        uint64_t timeout_count() const { return timeouts; }
+        uint64_t retry_count() const { return retries; }
+
+    private:
+        struct Command {
+            std::string text;
+            bool expects_reply;
+            latency_clock::duration timeout;
+            command_done done;
+            int attempts;
+        };
+
+        command_writer writer;
+        wakeup wake;
+
+        std::mutex lk_commands;
+        std::deque<Command> pending;
+        Command current;
+        bool in_flight = false;
+        bool replied = false;
+        bool reply_error = false;
+        latency_clock::time_point sent_at;
+        latency_clock::time_point replied_at;
+        latency_clock::time_point deadline;
+
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> retries{0};
+        LatencyHistogram reply_time;
+};
+
+#endif
@@ -0,0 +1,94 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __FRAME_SCANNER__
+#define __FRAME_SCANNER__
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#define FRAME_BUFFER_SIZE 65536
+#define MAX_ASCII_LINE 4096
+
+enum frame_type
+{
+    FRAME_NMEA,     // $xxYYY,...*hh<CR><LF>
+    FRAME_RTCM3,    // 0xD3 framed, CRC-24Q checked
+    FRAME_SBF,      // $@ framed Septentrio Binary Format block, CRC-16 checked
+    FRAME_REPLY,    // $R: / $R? / $R; command reply line of the receiver
+    FRAME_TYPES
+};
+
+// View on a complete frame. Only valid during the call of the frame handler.
+struct Frame
+{
+    frame_type type;
+    const uint8_t *data;
+    size_t size;
+};
+
+/*  Incremental scanner cutting the byte stream of a receiver channel into complete frames.
+    Bytes are scanned in place: a frame fully contained in the fed data is handed out without copy,
+    only the trailing partial frame of a read is kept in the internal buffer until the next feed().
+    Bytes that are not part of a recognized frame (prompts, noise, corrupted frames) are skipped. */
+class FrameScanner
+{
+public:
+    typedef std::function<void(const Frame &frame)> frame_handler;
+
+    explicit FrameScanner(frame_handler handler) : on_frame(handler) {}
+
+    void feed(const uint8_t *data, size_t size);
+    void reset() { pending_size = 0; pending_need = 0; }
+
+    // Statistics, only updated from the feeding thread
+    uint64_t frames[FRAME_TYPES] = {};
+    uint64_t crc_errors = 0;
+    uint64_t skipped_bytes = 0;
+
+private:
+    // Returns the number of bytes consumed from data (frames and skipped bytes)
+    size_t scan(const uint8_t *data, size_t size);
+
+    // Length of the frame starting at data, 0 if incomplete, -1 if not a valid frame start
+    long frame_length(const uint8_t *data, size_t size, frame_type &type);
+
+    frame_handler on_frame;
+
+    uint8_t pending[FRAME_BUFFER_SIZE];
+    size_t pending_size = 0;
+
+    // Total length of the pending frame when its header is complete, 0 otherwise
+    size_t pending_need = 0;
+};
+
+#endif
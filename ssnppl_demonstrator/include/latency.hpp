@@ -0,0 +1,186 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __LATENCY__
+#define __LATENCY__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+typedef std::chrono::steady_clock latency_clock;
+
+/*  Lock-free HDR-style latency histogram in microseconds. Each power of two range is split in
+    SUB_BUCKETS linear buckets, so a sample is known within 1/SUB_BUCKETS (6%) of its value;
+    samples below SUB_BUCKETS us are exact and samples from 2^MAX_BITS us (~12 days) are clamped.
+    record() may be called from any thread, percentiles are reported as the bucket upper bound. */
+class LatencyHistogram {
+    public:
+        static const int SUB_BITS = 4;
+        static const int SUB_BUCKETS = 1 << SUB_BITS;
+        static const int MAX_BITS = 40;
+        static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+        void record(latency_clock::duration elapsed) {
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+            if (us < 0) us = 0;
+            if (us >= (int64_t(1) << MAX_BITS)) us = (int64_t(1) << MAX_BITS) - 1;
+
+            buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+            samples.fetch_add(1, std::memory_order_relaxed);
+            total_us.fetch_add(us, std::memory_order_relaxed);
+
+            int64_t prev = max_us.load(std::memory_order_relaxed);
+            while (us > prev && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+        }
+
+        void record_since(latency_clock::time_point start) { record(latency_clock::now() - start); }
+
+        uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+        int64_t sum_us() const { return total_us.load(std::memory_order_relaxed); }
+
+        // Upper bound in us of the bucket holding the given percentile (0-100)
+        int64_t percentile(double pct) const {
+            uint64_t total = count();
+            if (total == 0) return 0;
+
+            uint64_t target = (uint64_t)(total * pct / 100.0 + 0.5);
+            if (target == 0) target = 1;
+
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += buckets[i].load(std::memory_order_relaxed);
+                if (seen >= target) return std::min(upper_bound_of(i), max_us.load(std::memory_order_relaxed));
+            }
+            return max_us.load(std::memory_order_relaxed);
+        }
+
+        void print(std::ostream &os, const std::string &name) const {
+            uint64_t total = count();
+            os << "  *" << std::left << std::setw(24) << name << std::right;
+            if (total == 0) {
+                os << "no samples" << std::endl;
+                return;
+            }
+            os << "n=" << total
+               << " mean=" << total_us.load(std::memory_order_relaxed) / (int64_t)total << "us"
+               << " p50<=" << percentile(50) << "us"
+               << " p90<=" << percentile(90) << "us"
+               << " p99<=" << percentile(99) << "us"
+               << " max=" << max_us.load(std::memory_order_relaxed) << "us" << std::endl;
+        }
+
+    private:
+        static int bucket_of(int64_t us) {
+            if (us < SUB_BUCKETS) return (int)us;
+
+            int msb = 63 - __builtin_clzll((unsigned long long)us);
+            int shift = msb - SUB_BITS;
+            return (shift + 1) * SUB_BUCKETS + (int)((us >> shift) & (SUB_BUCKETS - 1));
+        }
+
+        // Largest value (in us) counted by a bucket
+        static int64_t upper_bound_of(int bucket) {
+            if (bucket < SUB_BUCKETS) return bucket;
+
+            int shift = bucket / SUB_BUCKETS - 1;
+            int64_t sub = bucket % SUB_BUCKETS;
+            return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+        }
+
+        std::atomic<uint64_t> buckets[BUCKETS] = {};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<int64_t> total_us{0};
+        std::atomic<int64_t> max_us{0};
+};
+
+// Stages crossed by a correction, from its arrival (MQTT callback or LBand read) to the RTCM write
+enum latency_stage {
+    STAGE_QUEUE,        // arrival to dispatch
+    STAGE_PPL_SEND,     // SPARTN given to the PPL
+    STAGE_PPL_RTCM,     // RTCM taken from the PPL
+    STAGE_RTCM_QUEUE,   // RTCM queued to write_rtcm()
+    STAGE_WRITE,        // RTCM written to the receiver
+    STAGE_TOTAL,        // arrival to RTCM written
+    LATENCY_STAGES
+};
+
+enum correction_source { SOURCE_MQTT, SOURCE_LBAND, CORRECTION_SOURCES };
+
+// Per source and per stage histograms of the correction path, recorded lock-free from any thread
+class CorrectionLatency {
+    public:
+        void record(correction_source source, latency_stage stage, latency_clock::duration elapsed) {
+            stages[source][stage].record(elapsed);
+        }
+
+        const LatencyHistogram &histogram(correction_source source, latency_stage stage) const {
+            return stages[source][stage];
+        }
+
+        void print(std::ostream &os) const {
+            for (int source = 0; source < CORRECTION_SOURCES; source++) {
+                if (stages[source][STAGE_QUEUE].count() == 0) continue;
+                for (int stage = 0; stage < LATENCY_STAGES; stage++)
+                    stages[source][stage].print(os, std::string(source_names()[source]) + " " + stage_names()[stage]);
+            }
+        }
+
+        // One line for the periodic stats: arrival to RTCM written of each source
+        void print_line(std::ostream &os) const {
+            os << "Correction latency:";
+            for (int source = 0; source < CORRECTION_SOURCES; source++) {
+                const LatencyHistogram &total = stages[source][STAGE_TOTAL];
+                if (total.count() == 0) continue;
+                os << " " << source_names()[source] << " n=" << total.count()
+                   << " p50<=" << total.percentile(50) << "us p99<=" << total.percentile(99) << "us";
+            }
+        }
+
+        static const char *const *source_names() {
+            static const char *const names[CORRECTION_SOURCES] = {"MQTT", "LBand"};
+            return names;
+        }
+        static const char *const *stage_names() {
+            static const char *const names[LATENCY_STAGES] = {"queue", "PPL send", "PPL RTCM", "RTCM queue", "write", "total"};
+            return names;
+        }
+
+    private:
+
+        LatencyHistogram stages[CORRECTION_SOURCES][LATENCY_STAGES];
+};
+
+#endif
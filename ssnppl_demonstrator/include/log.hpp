@@ -0,0 +1,158 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __LOG__
+#define __LOG__
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <streambuf>
+#include <chrono>
+#include "queue.hpp"
+
+#define LOG_LINE_SIZE 256                       // longer lines are truncated
+#define LOG_RING_SIZE 1024                      // lines waiting for the writer thread, more are dropped
+#define LOG_RATE_LIMIT std::chrono::seconds(1)  // one LOG_LIMITED line per call site and period
+
+enum log_level {
+    LEVEL_DEBUG,
+    LEVEL_INFO,
+    LEVEL_WARN,
+    LEVEL_ERROR,
+    LEVEL_OFF
+};
+
+// Debug logs are compiled out unless the build sets SSNPPL_DEBUG_LOGS
+#ifndef SSNPPL_LOG_MIN_LEVEL
+#ifdef SSNPPL_DEBUG_LOGS
+#define SSNPPL_LOG_MIN_LEVEL LEVEL_DEBUG
+#else
+#define SSNPPL_LOG_MIN_LEVEL LEVEL_INFO
+#endif
+#endif
+
+bool parse_log_level(const std::string &name, log_level &level);
+
+/*  Process wide logger. Producers format a line on their stack and copy it to a lock-free ring,
+    a background thread writes the lines to the console and flushes once per batch.
+    Before start() and after stop() lines are written directly by the calling thread. */
+class Logger {
+    public:
+        static Logger &instance();
+
+        void start(log_level level);
+        void stop();
+
+        bool enabled(log_level level) const { return level >= min_level.load(std::memory_order_relaxed); }
+        void push(log_level level, const char *text, size_t size);
+        uint64_t drops() const { return ring.drops(); }
+
+    private:
+        struct Record {
+            log_level level;
+            size_t size;
+            char text[LOG_LINE_SIZE];
+        };
+
+        Logger() = default;
+        void write_lines();
+
+        MpscRing<Record> ring{LOG_RING_SIZE};
+        std::atomic<log_level> min_level{LEVEL_INFO};
+        std::atomic<bool> running{false};
+        std::thread writer_thread;
+        std::mutex lk_writer;
+        std::condition_variable cv_writer;
+};
+
+// One log line formatted in place with operator<<, handed to the logger when it goes out of scope
+class LogLine {
+    public:
+        explicit LogLine(log_level level) : level(level), buffer(text, sizeof(text)), os(&buffer) {}
+        ~LogLine() { Logger::instance().push(level, text, buffer.size()); }
+
+        std::ostream &stream() { return os; }
+
+    private:
+        class FixedBuffer : public std::streambuf {
+            public:
+                FixedBuffer(char *begin, size_t size) { setp(begin, begin + size); }
+                size_t size() const { return pptr() - pbase(); }
+        };
+
+        log_level level;
+        char text[LOG_LINE_SIZE];
+        FixedBuffer buffer;
+        std::ostream os;
+};
+
+// Lets one line per LOG_RATE_LIMIT through and counts the others
+class LogLimiter {
+    public:
+        bool allow(uint64_t &suppressed);
+
+    private:
+        std::atomic<int64_t> next_ns{0};
+        std::atomic<uint64_t> skipped{0};
+};
+
+#define SSNPPL_LOG(level, message)                                                           \
+    do {                                                                                     \
+        if ((level) >= SSNPPL_LOG_MIN_LEVEL && Logger::instance().enabled(level)) {          \
+            LogLine log_line(level);                                                         \
+            log_line.stream() << message;                                                    \
+        }                                                                                    \
+    } while (0)
+
+#define LOG_DEBUG(message) SSNPPL_LOG(LEVEL_DEBUG, message)
+#define LOG_INFO(message) SSNPPL_LOG(LEVEL_INFO, message)
+#define LOG_WARN(message) SSNPPL_LOG(LEVEL_WARN, message)
+#define LOG_ERROR(message) SSNPPL_LOG(LEVEL_ERROR, message)
+
+// For errors that can repeat on every message: at most one line per LOG_RATE_LIMIT from this call site
+#define LOG_LIMITED(level, message)                                                          \
+    do {                                                                                     \
+        static LogLimiter log_limiter;                                                       \
+        uint64_t log_suppressed = 0;                                                         \
+        if ((level) >= SSNPPL_LOG_MIN_LEVEL && Logger::instance().enabled(level) &&          \
+            log_limiter.allow(log_suppressed)) {                                             \
+            LogLine log_line(level);                                                         \
+            log_line.stream() << message;                                                    \
+            if (log_suppressed > 0)                                                          \
+                log_line.stream() << " (" << log_suppressed << " more since the last one)";  \
+        }                                                                                    \
+    } while (0)
+
+#endif
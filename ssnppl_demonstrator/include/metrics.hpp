@@ -0,0 +1,75 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __METRICS__
+#define __METRICS__
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <boost/asio.hpp>
+
+#define METRICS_MAX_REQUEST 2048
+
+/*  Prometheus text exporter on 127.0.0.1, served by its own io_service thread.
+    Every HTTP request gets the output of the collector, which must only read atomics
+    so that a scrape never takes a lock of the correction path. */
+class MetricsServer {
+    public:
+        typedef std::function<void(std::ostream &)> collector;
+
+        explicit MetricsServer(collector collect) : collect(collect) {}
+        ~MetricsServer() { stop(); }
+
+        bool start(unsigned short port);
+        void stop();
+
+        uint64_t scrapes() const { return scrape_count.load(std::memory_order_relaxed); }
+
+    private:
+        void accept_next();
+
+        collector collect;
+        boost::asio::io_service io_service;
+        boost::asio::ip::tcp::acceptor acceptor{io_service};
+        std::thread server_thread;
+        std::atomic<uint64_t> scrape_count{0};
+};
+
+// "# HELP" and "# TYPE" lines of a metric family
+inline void metric_family(std::ostream &os, const char *name, const char *type, const char *help)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+#endif
@@ -0,0 +1,114 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __MOTION__
+#define __MOTION__
+
+#include <cmath>
+
+// Meters per degree of latitude
+#define MOTION_METERS_PER_DEGREE 111195.0f
+
+// Fixes closer in time give a noisy velocity, further apart a stale one
+#define MOTION_MIN_INTERVAL 0.5
+#define MOTION_MAX_INTERVAL 10.0
+
+// Below this speed (m/s) the position noise dominates, nothing is predicted
+#define MOTION_MIN_SPEED 1.0f
+
+/*  Velocity of the receiver from consecutive position fixes, smoothed over the last ones,
+    to anticipate the tile and node the localized service will need next. */
+class MotionPredictor {
+    public:
+        // time of the fix in seconds of the day (GGA UTC time)
+        void add_fix(float latitude, float longitude, double time) {
+            if (!has_fix) {
+                set_last(latitude, longitude, time);
+                return;
+            }
+
+            double interval = time - last_time;
+            if (interval < 0)
+                interval += 86400; // midnight
+            if (interval < MOTION_MIN_INTERVAL)
+                return;
+            if (interval > MOTION_MAX_INTERVAL) {
+                valid = false;
+                set_last(latitude, longitude, time);
+                return;
+            }
+
+            float meters_per_degree_lon = MOTION_METERS_PER_DEGREE * std::cos(latitude * float(M_PI / 180));
+            float fix_north = (latitude - last_lat) * MOTION_METERS_PER_DEGREE / interval;
+            float fix_east = wrap_degrees(longitude - last_lon) * meters_per_degree_lon / interval;
+            north = valid ? (north + fix_north) / 2 : fix_north;
+            east = valid ? (east + fix_east) / 2 : fix_east;
+            valid = true;
+            set_last(latitude, longitude, time);
+        }
+
+        bool moving() const { return valid && speed() >= MOTION_MIN_SPEED; }
+        float speed() const { return std::sqrt(north * north + east * east); }
+
+        // Degrees clockwise from north
+        float heading() const {
+            float degrees = std::atan2(east, north) * float(180 / M_PI);
+            return degrees < 0 ? degrees + 360 : degrees;
+        }
+
+        // Position in seconds from the last fix at the current velocity
+        void predict(float seconds, float &latitude, float &longitude) const {
+            latitude = last_lat + north * seconds / MOTION_METERS_PER_DEGREE;
+            longitude = wrap_degrees(last_lon + east * seconds / (MOTION_METERS_PER_DEGREE * std::cos(last_lat * float(M_PI / 180))));
+        }
+
+    private:
+        static float wrap_degrees(float degrees) {
+            if (degrees > 180) return degrees - 360;
+            if (degrees < -180) return degrees + 360;
+            return degrees;
+        }
+
+        void set_last(float latitude, float longitude, double time) {
+            last_lat = latitude;
+            last_lon = longitude;
+            last_time = time;
+            has_fix = true;
+        }
+
+        bool has_fix = false;
+        bool valid = false;
+        float last_lat = 0, last_lon = 0;
+        double last_time = 0;
+        float north = 0, east = 0; // m/s
+};
+
+#endif
@@ -43,13 +43,81 @@
 #include <mosquitto.h> 
 #include <queue>
 #include <mutex>
+#include <functional>
 #include <condition_variable>
+#include "queue.hpp"
+#include "latency.hpp"
+
+#define MAX_MQTT_PAYLOAD 4096
+#define MAX_MQTT_TOPIC 128
+#define MAX_BOUND_TOPICS 8
+
+// Role of a subscribed topic, used to pick the handler of its messages
+enum topic_id {
+    TOPIC_NONE = -1,
+    TOPIC_KEY,
+    TOPIC_FREQ,
+    TOPIC_CORR,
+    TOPIC_NODE,
+    TOPIC_TILE,
+    TOPIC_NODE_WARM, // node subscribed ahead of a predicted switch, its messages are dropped
+    TOPIC_IDS
+};
+
+// Topics of the localized service changed at run time by the dispatch thread, one slot each
+enum current_slot {
+    CURRENT_NODE,
+    CURRENT_TILE,          // until its dictionary is received
+    CURRENT_PREFETCH_TILE, // until its dictionary is received
+    CURRENT_WARM_NODE,
+    CURRENT_SLOTS
+};
 
+/*  Subscribed topics and their ID. A topic is bound when it is subscribed and unbound when it is
+    unsubscribed, so each incoming message is resolved with one hash compare and no allocation.
+    The table also holds the current topic of each slot, which a client subscribes from its network
+    thread when it connects: a subscription made before the CONNACK fails. */
+class TopicTable {
+    public:
+        void bind(const std::string &topic, topic_id id);
+        void unbind(const std::string &topic);
+        topic_id resolve(const char *topic);
+
+        // Set by the dispatch thread before it unsubscribes the previous topic of the slot, "" for none
+        void set_current(current_slot slot, const std::string &topic, topic_id id);
+        // Clears the slots holding the topic, e.g. a tile once its dictionary is received
+        void drop_current(const std::string &topic);
+        /*  Subscribes the current topic of every slot with subscribe() and binds those subscribed, returns
+            their number. Under the table lock so a set_current() lands before or after. */
+        size_t bind_current(const std::function<bool(const std::string &topic, topic_id id)> &subscribe);
+
+    private:
+        struct Entry {
+            uint32_t hash;
+            std::string topic;
+            topic_id id;
+        };
+
+        std::mutex lk_entries;
+        Entry entries[MAX_BOUND_TOPICS];
+        size_t count{0};
+
+        struct Current {
+            std::string topic;
+            topic_id id = TOPIC_NONE;
+        };
+        Current current[CURRENT_SLOTS];
+
+        void bind_locked(const std::string &topic, topic_id id);
+};
 
 struct mqttMessgae {
+    topic_id id;
     std::string topic;
     std::string payload;
     int payloadlen;
+    latency_clock::time_point stamp; // arrival in mqtt_on_message()
+    struct mosquitto *client;        // two clients are connected while switching broker
 };
 
 typedef struct {
@@ -77,16 +145,31 @@ typedef struct {
     std::string tileTopic =""  ;
     const int tileQoS = 0 ;
 
-    // Current Node Topic MQTT
+    // Current Node Topic MQTT, dispatch thread only, the network threads read the CURRENT_NODE slot of topics
     std::string nodeTopic = "" ;
     const int nodeQoS = 0 ;
 
-    //PPL
-    std::queue<struct mqttMessgae> message_queue;
-    std::mutex message_queue_mutex;
+    // Topics subscribed by this client, bound to their ID
+    TopicTable topics;
+    std::atomic<uint64_t> unknown_topics{0}; // messages dropped because their topic is not bound
+    std::atomic<uint64_t> topic_messages[TOPIC_IDS] = {};
+    std::atomic<uint64_t> topic_bytes[TOPIC_IDS] = {};
+    std::atomic<uint64_t> connects{0};
 
-    //CV incoming data
+    //PPL
+    /* Pool of message buffers: the callback copies each payload once into a slot, the slot is then
+       handed by pointer to PPL and the SPARTN log. Buffers only grow for a payload larger than all previous ones. */
+    SpscRing<struct mqttMessgae> message_queue{MAX_MQTT_QUEUE_SIZE, RING_DROP_OLDEST, [](struct mqttMessgae &slot) {
+        slot.topic.reserve(MAX_MQTT_TOPIC);
+        slot.payload.reserve(MAX_MQTT_PAYLOAD);
+    }};
+    std::mutex lk_producer; // two network threads push while switching broker
+    BatchCounters message_counters;
+    std::atomic<uint64_t> message_allocations{0}; // slot buffers grown by the callback
+
+    //CV incoming data, lk_incoming_data is taken before notifying
     std::condition_variable_any *cv_incoming_data;
+    std::mutex *lk_incoming_data;
 
 }UserData;
 
@@ -94,4 +177,11 @@ void mqtt_on_connect(struct mosquitto *mqttClient, void *userdata, int result);
 
 void mqtt_on_message(struct mosquitto *mqttClient, void *userdata, const struct mosquitto_message *message);
 
+/*  Dispatch thread: replaces the topic of the slot by topic ("" for none). topic is made current first, so a
+    client connecting meanwhile subscribes it, then previous is unsubscribed on client and on draining (the client
+    of the previous broker while switching, may be nullptr) and unbound, then topic is subscribed on client and
+    bound. Before the CONNACK of client, mqtt_on_connect() subscribes it. False if the subscription failed. */
+bool mqtt_replace_topic(UserData *user_data, struct mosquitto *client, struct mosquitto *draining,
+                        current_slot slot, const std::string &previous, const std::string &topic, topic_id id);
+
 #endif
\ No newline at end of file
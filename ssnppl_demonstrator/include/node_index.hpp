@@ -0,0 +1,78 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __NODE_INDEX__
+#define __NODE_INDEX__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*  Nodes of the current tile for the nearest node lookup of the localized service.
+    The names of the /dict payload ("N4950E00725": latitude and longitude in 1/100 degree) are parsed once by build()
+    into arrays of radians with their cosine, bucketed on a grid of about one node per cell.
+    nearest() visits the cells ring by ring around the position, ranks the nodes with the equirectangular
+    distance and compares the haversine of the few nodes within NODE_INDEX_PREFILTER of the best one. */
+class NodeIndex {
+    public:
+        // Returns the number of names that could not be parsed, they are left out
+        size_t build(const std::vector<std::string> &nodes);
+
+        // Index of the node closest to the position in degrees, -1 without nodes
+        int nearest(float latitude, float longitude) const;
+
+        // Index of the node name, -1 if it is not in the tile
+        int find(const std::string &node) const;
+
+        size_t size() const { return names.size(); }
+        const std::string &name(size_t index) const { return names[index]; }
+        void position(size_t index, float &latitude, float &longitude) const {
+            latitude = lat[index] * (180 / 3.14159265358979f);
+            longitude = lon[index] * (180 / 3.14159265358979f);
+        }
+
+    private:
+        float lower_bound(int row, int col, int ring, float query_lat, float query_lon, float query_cos) const;
+
+        std::vector<std::string> names;
+        std::vector<float> lat;
+        std::vector<float> lon;
+        std::vector<float> cos_lat;
+
+        // Cell c holds cell_nodes[cell_start[c]] to cell_nodes[cell_start[c + 1] - 1], rows of cells by latitude
+        float min_lat = 0, min_lon = 0, cell_lat = 1, cell_lon = 1;
+        float min_cos_lat = 1; // over the grid, scales the longitudes for the bounds
+        int rows = 0, cols = 0;
+        std::vector<uint32_t> cell_start;
+        std::vector<uint32_t> cell_nodes;
+};
+
+#endif
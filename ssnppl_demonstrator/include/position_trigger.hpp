@@ -0,0 +1,110 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __POSITION_TRIGGER__
+#define __POSITION_TRIGGER__
+
+#include "motion.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Default of --recompute_interval: recomputations of the tile and node at most this often, in seconds of GGA time
+#define POSITION_MIN_INTERVAL 5.0
+
+// Default of --hysteresis: margin (m) by which the position must leave a tile, or another node be closer, before switching
+#define POSITION_HYSTERESIS 1000.0f
+
+/*  Decides when the localized service recomputes its tile and node: once the position has moved
+    --distance meters from where they were last computed, converted to latitude and longitude deltas,
+    and not more often than --recompute_interval. The --hysteresis margin keeps a position
+    jittering across a tile or node boundary on the current one, whatever the distance. */
+class PositionTrigger {
+    public:
+        void set_distance(float meters) { distance = std::max(meters, 0.0f); }
+        void set_hysteresis(float meters) { hysteresis = std::max(meters, 0.0f); }
+        void set_min_interval(double seconds) { min_interval = std::max(seconds, 0.0); }
+
+        // time of the fix in seconds of the day (GGA UTC time), negative when unknown
+        bool update(float latitude, float longitude, double time) {
+            if (has_anchor) {
+                float latitude_delta = distance / MOTION_METERS_PER_DEGREE;
+                float longitude_delta = latitude_delta / std::max(std::cos(anchor_lat * float(M_PI / 180)), 0.01f);
+                if (std::fabs(latitude - anchor_lat) <= latitude_delta && std::fabs(wrap_degrees(longitude - anchor_lon)) <= longitude_delta)
+                    return false;
+
+                double interval = time - last_time;
+                if (interval < 0)
+                    interval += 86400; // midnight
+                if (time >= 0 && last_time >= 0 && interval < min_interval)
+                    return false;
+            }
+
+            anchor_lat = latitude;
+            anchor_lon = longitude;
+            last_time = time;
+            has_anchor = true;
+            return true;
+        }
+
+        /*  Whether the tile of scale degrees holding (tile_latitude, tile_longitude) still applies to the
+            position: it is inside the tile or outside by less than the margin. */
+        bool keep_tile(float latitude, float longitude, float tile_latitude, float tile_longitude, float scale) const {
+            float latitude_margin = hysteresis / MOTION_METERS_PER_DEGREE;
+            float longitude_margin = latitude_margin / std::max(std::cos(latitude * float(M_PI / 180)), 0.01f);
+            return within_cell(latitude, tile_latitude, scale, latitude_margin) &&
+                   within_cell(longitude, tile_longitude, scale, longitude_margin);
+        }
+
+        // Whether the current node stays: the nearest one is not closer by more than the margin
+        bool keep_node(float current_meters, float nearest_meters) const { return current_meters - nearest_meters <= hysteresis; }
+
+    private:
+        static float wrap_degrees(float degrees) {
+            if (degrees > 180) return degrees - 360;
+            if (degrees < -180) return degrees + 360;
+            return degrees;
+        }
+
+        // Cells are [k * scale, (k + 1) * scale), as the tile topic
+        static bool within_cell(float value, float cell_value, float scale, float value_margin) {
+            float cell = std::floor(cell_value / scale);
+            return std::floor((value - value_margin) / scale) <= cell && cell <= std::floor((value + value_margin) / scale);
+        }
+
+        float distance = 0;
+        float hysteresis = POSITION_HYSTERESIS;
+        double min_interval = POSITION_MIN_INTERVAL;
+        bool has_anchor = false;
+        float anchor_lat = 0, anchor_lon = 0;
+        double last_time = -1;
+};
+
+#endif
@@ -0,0 +1,120 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __PPL_BACKEND__
+#define __PPL_BACKEND__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <iostream>
+
+/*  Interface to the PointPerfect Library. The glue code only talks to a PplBackend, so it builds
+    and runs without the licensed library: the "real" backend wraps PPL_PublicInterface.h, the
+    "mock" backend answers with synthetic RTCM for load tests and profiling. */
+
+// Largest RTCM output of one get_rtcm_output() call, PPL_MAX_RTCM_BUFFER of the library
+#define PPL_RTCM_BUFFER_SIZE (19 + 164 + 12 + (450 * 7))
+
+// Status of a PPL call, the ePPL_ReturnStatus value with the real library
+typedef int ppl_status;
+#define PPL_STATUS_SUCCESS 0
+#define PPL_STATUS_INCORRECT_USAGE 1
+#define PPL_STATUS_INIT_FAILED 2
+
+enum ppl_channel {
+    PPL_CHANNEL_IP = 1,
+    PPL_CHANNEL_AUX = 2
+};
+
+class PplBackend {
+    public:
+        virtual ~PplBackend() {}
+
+        virtual const char *name() const = 0;
+
+        // channels is a mask of ppl_channel
+        virtual ppl_status initialize(unsigned int channels) = 0;
+        virtual ppl_status send_dynamic_key(const char *key, size_t size) = 0;
+        virtual ppl_status send_spartn(const void *data, size_t size) = 0;
+        virtual ppl_status send_aux_spartn(const void *data, size_t size) = 0;
+        virtual ppl_status send_rcvr_data(const void *data, size_t size) = 0;
+        virtual ppl_status get_rtcm_output(uint8_t *buffer, size_t size, uint32_t *rtcm_size) = 0;
+
+        virtual void print(std::ostream &/*os*/) const {}
+};
+
+struct MockPplConfig {
+    unsigned int cost_us = 0;    // CPU time burnt by every call
+    unsigned int rtcm_bytes = 0; // RTCM3 payload per SPARTN message, 0 for the SPARTN message length
+};
+
+/*  Stand-in for the library: every SPARTN message accepted (IP or aux channel) is answered with one
+    CRC-valid RTCM3 frame (message 4062) on the next get_rtcm_output(). Not thread safe, like the
+    library it is only called from the PPL thread. */
+class MockPpl : public PplBackend {
+    public:
+        explicit MockPpl(const MockPplConfig &config) : config(config) {}
+
+        const char *name() const override { return "mock"; }
+
+        ppl_status initialize(unsigned int channels) override;
+        ppl_status send_dynamic_key(const char *key, size_t size) override;
+        ppl_status send_spartn(const void *data, size_t size) override;
+        ppl_status send_aux_spartn(const void *data, size_t size) override;
+        ppl_status send_rcvr_data(const void *data, size_t size) override;
+        ppl_status get_rtcm_output(uint8_t *buffer, size_t size, uint32_t *rtcm_size) override;
+
+        void print(std::ostream &os) const override;
+
+    private:
+        ppl_status accept_spartn(const void *data, size_t size, unsigned int channel);
+        void spend() const;
+
+        MockPplConfig config;
+        unsigned int channels = 0;
+        bool initialized = false;
+        std::deque<uint16_t> pending; // payload length of each RTCM3 frame still to output
+
+        enum { CALL_KEY, CALL_SPARTN, CALL_AUX_SPARTN, CALL_RCVR, CALL_RTCM, CALLS };
+        uint64_t calls[CALLS] = {};
+        uint64_t rtcm_frames = 0;
+        uint64_t rtcm_bytes = 0;
+};
+
+// Backend compiled in by default, "real" when the library is linked
+const char *default_ppl_backend();
+
+// nullptr when name is unknown or not part of this build
+PplBackend *create_ppl_backend(const std::string &name, const MockPplConfig &mock_config);
+
+#endif
@@ -45,6 +45,7 @@
 #include <cstring>
 #include <csignal>
 #include <fstream>
+#include "ppl_backend.hpp"
 
 namespace po = boost::program_options;
 
@@ -55,9 +56,26 @@ struct ProgramOptions {
     bool reset_default;
     bool send_cmds;
     int timer;
+    int stats_interval;
+    std::string log_level;
+    int metrics_port;
+    std::string ingest;
+    std::string queue_overflow;
+    std::string replay;
+    double replay_speed;
+    std::string rtcm_output;
+    std::string ppl_backend;
+    unsigned int ppl_mock_cost_us;
+    unsigned int ppl_mock_rtcm_bytes;
 
     // Logging Configuration
     std::string SPARTN_Logging;
+    std::string SPARTN_Log_sync;
+    int SPARTN_Log_flush_kb;
+    int SPARTN_Log_flush_ms;
+    std::string SPARTN_Log_rotate;
+    std::string rcvr_capture;
+    std::string startup_trace;
     std::string logging;
     std::string SBF_Logging_Config;
     std::string NMEA_Logging_Config;
@@ -92,6 +110,11 @@ struct ProgramOptions {
     bool localized ;
     int tile_level ; 
     int distance ;
+    int hysteresis ;
+    double recompute_interval ;
+    std::string tile_cache;
+    int tile_cache_size;
+    int tile_cache_ttl;
 
 };
 
@@ -35,10 +35,22 @@
 #include <queue>
 #include <vector>
 #include <cstdint>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <functional>
+#include <utility>
+#include <thread>
+#include <chrono>
 
 #define MAX_CORR_QUEUE_SIZE 10
 #define MAX_LBAND_QUEUE_SIZE 10
-#define MAX_RECEIVER_QUEUE_SIZE 15
+#define MAX_RECEIVER_QUEUE_SIZE 128
+#define MAX_RTCM_QUEUE_SIZE 10
+#define MAX_MQTT_QUEUE_SIZE 32
+
+#define CACHE_LINE_SIZE 64
 
 class MyQueue {
     public:
@@ -86,4 +98,209 @@ class MyQueue {
         std::size_t maxQueueSize;
 };
 
+enum ring_overflow {
+    RING_DROP_OLDEST,   // the producer discards the oldest element, like MyQueue
+    RING_BLOCK          // the producer waits for the consumer
+};
+
+/*  Bounded lock-free ring for exactly one producer thread and one consumer thread.
+    Slots are allocated once by the Ctor (init can reserve their buffers) and reused in place:
+    the producer fills the slot returned by begin_push() then publishes it with end_push().
+    pop() swaps the oldest slot with the consumer's own element and returns it, valid until the next pop():
+    the buffers circulate between the ring and the consumer without copies, and the consumer holds no ring
+    slot while it works, so a full ring in drop-oldest mode always drops the oldest element, never the new one.
+    head and tail live on their own cache lines so both threads do not share a line on every hand-off. */
+template <typename T>
+class SpscRing {
+    public:
+        SpscRing(std::size_t maxSize, ring_overflow overflow = RING_DROP_OLDEST, std::function<void(T &)> init = nullptr)
+            : slots(maxSize + 1), maxQueueSize(maxSize), policy(overflow) {
+            // One more slot than the capacity: the one the consumer is swapping out is never reused by the producer
+            if (init) {
+                for (T &slot : slots) init(slot);
+                init(current);
+            }
+        }
+
+        void setOverflow(ring_overflow overflow) { policy = overflow; }
+
+        // Producer side. Returns nullptr when the element must be dropped or the ring was closed.
+        T *begin_push() {
+            std::size_t h = head.load(std::memory_order_relaxed);
+
+            for (int spins = 0;; spins++) {
+                std::size_t t = tail.load();
+                std::size_t r = reading.load();
+                bool full = h - t >= maxQueueSize;
+                bool reading_slot = r != NOT_READING && h - r >= slots.size();
+
+                if (!full && !reading_slot) break;
+                if (closed.load()) return nullptr;
+
+                if (policy == RING_DROP_OLDEST && full) {
+                    // Race the consumer for the oldest element, whoever wins it is gone from the ring
+                    if (tail.compare_exchange_weak(t, t + 1)) dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                // Full blocking ring, or the consumer is swapping out the slot to fill (a few moves)
+                if (spins < 64) std::this_thread::yield();
+                else std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            return &slots[h % slots.size()];
+        }
+
+        void end_push() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // Consumer side. Takes the oldest element, nullptr if the ring is empty.
+        T *pop() {
+            std::size_t t = tail.load();
+            for (;;) {
+                if (t == head.load(std::memory_order_acquire)) {
+                    reading.store(NOT_READING);
+                    return nullptr;
+                }
+                // Announce the slot before claiming it so the producer never reuses it meanwhile
+                reading.store(t);
+                if (tail.compare_exchange_weak(t, t + 1)) {
+                    using std::swap;
+                    swap(current, slots[t % slots.size()]);
+                    reading.store(NOT_READING);
+                    return &current;
+                }
+            }
+        }
+
+        bool empty() const { return head.load(std::memory_order_acquire) == tail.load(); }
+        std::size_t size() const { return head.load(std::memory_order_acquire) - tail.load(); }
+        uint64_t drops() const { return dropped.load(std::memory_order_relaxed); }
+
+        // Releases a producer blocked on a full ring, used at shutdown
+        void close() { closed.store(true); }
+
+    private:
+        static const std::size_t NOT_READING = ~std::size_t(0);
+
+        std::vector<T> slots;
+        std::size_t maxQueueSize;
+        ring_overflow policy;
+        T current; // element handed to the consumer by pop()
+
+        std::atomic<std::size_t> head{0};
+        char head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> tail{0};
+        std::atomic<std::size_t> reading{NOT_READING};
+        char tail_padding[CACHE_LINE_SIZE - 2 * sizeof(std::atomic<std::size_t>)];
+
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> closed{false};
+};
+
+/*  Bounded lock-free ring for any number of producer threads and one consumer thread.
+    Each slot carries a sequence number telling whether it is free for the producer holding
+    that position or published for the consumer. A full ring drops the new element, producers never wait.
+    The capacity is rounded up to a power of two. */
+template <typename T>
+class MpscRing {
+    public:
+        MpscRing(std::size_t capacity, std::function<void(T &)> init = nullptr) : slots(round_up(capacity)), mask(slots.size() - 1) {
+            for (std::size_t i = 0; i < slots.size(); i++) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+                if (init) init(slots[i].value);
+            }
+        }
+
+        // Producer side. Returns nullptr when the ring is full, else a slot to fill then publish with end_push(ticket).
+        T *begin_push(std::size_t &ticket) {
+            std::size_t pos = head.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot &slot = slots[pos & mask];
+                std::intptr_t diff = (std::intptr_t)slot.sequence.load(std::memory_order_acquire) - (std::intptr_t)pos;
+                if (diff == 0) {
+                    if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        ticket = pos;
+                        return &slot.value;
+                    }
+                }
+                else if (diff < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        void end_push(std::size_t ticket) { slots[ticket & mask].sequence.store(ticket + 1, std::memory_order_release); }
+
+        // Consumer side. The oldest published element, nullptr if none, stays valid until pop().
+        T *front() {
+            Slot &slot = slots[tail & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return nullptr;
+            return &slot.value;
+        }
+
+        void pop() {
+            slots[tail & mask].sequence.store(tail + slots.size(), std::memory_order_release);
+            tail++;
+        }
+
+        uint64_t drops() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        static std::size_t round_up(std::size_t capacity) {
+            std::size_t size = 2;
+            while (size < capacity) size <<= 1;
+            return size;
+        }
+
+        std::vector<Slot> slots;
+        std::size_t mask;
+
+        std::atomic<std::size_t> head{0};
+        char head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+        std::size_t tail = 0; // consumer only
+
+        std::atomic<uint64_t> dropped{0};
+};
+
+// Depth and batch size counters of a queue drained in batches by a single consumer
+struct BatchCounters {
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> depth{0};
+    std::atomic<uint64_t> max_depth{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> max_batch{0};
+
+    // Producer side, called with the depth of the queue after the push
+    void on_push(std::size_t depth_after) {
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        depth.store(depth_after, std::memory_order_relaxed);
+        if (depth_after > max_depth.load(std::memory_order_relaxed)) max_depth.store(depth_after, std::memory_order_relaxed);
+    }
+
+    // Consumer side, called with the number of items taken at once (the queue is then empty)
+    void on_batch(std::size_t batch_size) {
+        depth.store(0, std::memory_order_relaxed);
+        if (batch_size == 0) return;
+        batches.fetch_add(1, std::memory_order_relaxed);
+        if (batch_size > max_batch.load(std::memory_order_relaxed)) max_batch.store(batch_size, std::memory_order_relaxed);
+    }
+
+    void print(std::ostream &os, const std::string &name, uint64_t drops = 0) const {
+        uint64_t n = batches.load(std::memory_order_relaxed);
+        os << "  *" << std::left << std::setw(24) << name << std::right
+           << "pushed=" << pushed.load(std::memory_order_relaxed)
+           << " batches=" << n
+           << " mean_batch=" << (n ? (double)pushed.load(std::memory_order_relaxed) / n : 0.0)
+           << " max_batch=" << max_batch.load(std::memory_order_relaxed)
+           << " max_depth=" << max_depth.load(std::memory_order_relaxed)
+           << " drops=" << drops << std::endl;
+    }
+};
+
 #endif // MYQUEUE_H
@@ -0,0 +1,73 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __REPLAY__
+#define __REPLAY__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include "spartn_log.hpp"
+
+// Chunk size when a capture without record headers is replayed
+#define REPLAY_RAW_CHUNK 4096
+
+/*  Reads back a log written by SpartnLogger one record at a time. A file that does not start
+    with the record sync is replayed as raw bytes, in chunks and without timestamps. */
+class ReplayReader {
+    public:
+        bool open(const std::string &file_name);
+        bool next();
+
+        bool valid() const { return has_record; }
+        bool raw() const { return raw_file; }
+
+        // Current record, time is 0 for raw files
+        uint64_t time_ns() const { return record_time; }
+        const uint8_t *data() const { return record.data(); }
+        size_t size() const { return record.size(); }
+
+        uint64_t records() const { return record_count; }
+        uint64_t bytes() const { return byte_count; }
+
+    private:
+        std::ifstream file;
+        std::string name;
+        bool raw_file = false;
+        bool has_record = false;
+        uint64_t record_time = 0;
+        std::vector<uint8_t> record;
+        uint64_t record_count = 0;
+        uint64_t byte_count = 0;
+};
+
+#endif
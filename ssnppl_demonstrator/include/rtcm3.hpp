@@ -0,0 +1,122 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __RTCM3__
+#define __RTCM3__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// RTCM3 frame: preamble, 6 reserved bits, 10 bits length, payload, CRC-24Q
+#define RTCM3_PREAMBLE 0xD3
+#define RTCM3_HEADER_SIZE 3
+#define RTCM3_CRC_SIZE 3
+#define RTCM3_MESSAGE_TYPES 4096
+
+// Message numbers kept by a scan, for display
+#define RTCM3_SCAN_IDS 32
+
+/*  Bits [pos, pos + len) of buff, most significant bit first, len up to 32.
+    The (at most 5) bytes spanned are loaded into one word, then shifted and masked once. */
+inline uint32_t rtcm3_getbitu(const uint8_t *buff, unsigned int pos, unsigned int len)
+{
+    const uint8_t *bytes = buff + pos / 8;
+    unsigned int shift = pos % 8;
+    unsigned int count = (shift + len + 7) / 8;
+
+    uint64_t word = 0;
+    for (unsigned int i = 0; i < count; i++)
+        word = (word << 8) | bytes[i];
+
+    return (uint32_t)((word >> (count * 8 - shift - len)) & ((uint64_t(1) << len) - 1));
+}
+
+/*  What is kept of an old epoch when the link to the receiver is overloaded.
+    HIGH: station, antenna and ephemeris messages, sent rarely and needed to use the rest.
+    NORMAL: observations, superseded by the next epoch.
+    LOW: anything else (SSR, proprietary). */
+enum rtcm3_priority { RTCM3_PRIORITY_LOW, RTCM3_PRIORITY_NORMAL, RTCM3_PRIORITY_HIGH };
+
+rtcm3_priority rtcm3_message_priority(uint16_t type);
+
+/*  Appends to out the frames of data whose message priority is at least min_priority and returns
+    the number of frames left out. Frames are delimited by their length field, the CRC is not checked. */
+size_t rtcm3_append_frames(const uint8_t *data, size_t size, rtcm3_priority min_priority, std::vector<uint8_t> &out);
+
+// Result of one scan, no allocation: the first RTCM3_SCAN_IDS message numbers and the error counts
+struct Rtcm3Scan {
+    uint16_t ids[RTCM3_SCAN_IDS];
+    size_t id_count = 0;
+    size_t frames = 0;
+    size_t crc_errors = 0;
+    size_t skipped_bytes = 0;   // bytes outside of any frame
+    size_t truncated_bytes = 0; // incomplete frame at the end of the buffer
+};
+
+/*  Validates RTCM3 buffers frame by frame and counts frames and bytes per message number.
+    scan() is called by a single thread, the counters can be read from any thread. */
+class Rtcm3Stats {
+    public:
+        Rtcm3Scan scan(const uint8_t *data, size_t size);
+
+        uint64_t frames(uint16_t type) const { return types[type % RTCM3_MESSAGE_TYPES].frames.load(std::memory_order_relaxed); }
+        uint64_t bytes(uint16_t type) const { return types[type % RTCM3_MESSAGE_TYPES].bytes.load(std::memory_order_relaxed); }
+        uint64_t total_frames() const { return frame_count.load(std::memory_order_relaxed); }
+        uint64_t total_crc_errors() const { return crc_errors.load(std::memory_order_relaxed); }
+        uint64_t total_skipped_bytes() const { return skipped_bytes.load(std::memory_order_relaxed); }
+        uint64_t total_truncated_bytes() const { return truncated_bytes.load(std::memory_order_relaxed); }
+
+        // Mean rate in frames per second between the first and the last frame of the type
+        double rate(uint16_t type) const;
+
+        void print(std::ostream &os, const std::string &name) const;
+
+    private:
+        struct TypeCounters {
+            std::atomic<uint64_t> frames{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<int64_t> first_ns{0};
+            std::atomic<int64_t> last_ns{0};
+        };
+
+        TypeCounters types[RTCM3_MESSAGE_TYPES];
+        std::atomic<uint64_t> frame_count{0};
+        std::atomic<uint64_t> crc_errors{0};
+        std::atomic<uint64_t> skipped_bytes{0};
+        std::atomic<uint64_t> truncated_bytes{0};
+};
+
+#endif
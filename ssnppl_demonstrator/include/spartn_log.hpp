@@ -0,0 +1,137 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __SPARTN_LOG__
+#define __SPARTN_LOG__
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include "latency.hpp"
+
+/*  Every record of a SPARTN log starts with a 16 bytes header, all fields little-endian:
+        "SPLG" | payload length (uint32) | arrival time in ns since the Unix epoch, UTC (uint64)
+    followed by the SPARTN payload as received from MQTT or the LBand channel. */
+#define SPARTN_LOG_SYNC "SPLG"
+#define SPARTN_LOG_HEADER_SIZE 16
+
+// Alignment of the writes and of the staging buffer with O_DIRECT
+#define SPARTN_LOG_BLOCK 4096
+
+enum log_sync {
+    LOG_SYNC_NONE,      // write(), the kernel decides when the data reaches the card
+    LOG_SYNC_FDATASYNC, // fdatasync() after every batch
+    LOG_SYNC_DIRECT     // O_DIRECT, blocks go around the page cache
+};
+
+enum log_rotation {
+    LOG_ROTATE_NONE,
+    LOG_ROTATE_SIZE,    // new file when rotate_bytes is reached, records are never split
+    LOG_ROTATE_GPS_HOUR // new file at each GPS hour
+};
+
+struct SpartnLogPolicy {
+    size_t flush_bytes = 16 * 1024;                       // wake the writer once this much is buffered
+    std::chrono::milliseconds flush_interval{500};        // or after this long
+    log_sync sync = LOG_SYNC_NONE;
+    log_rotation rotation = LOG_ROTATE_NONE;
+    uint64_t rotate_bytes = 0;
+};
+
+/*  SPARTN binary logger. log() only appends the record to the active buffer, a writer thread swaps
+    the buffers and writes the full one to the file, so a slow card never stalls correction delivery.
+    If the writer falls so far behind that the active buffer is full, records are dropped and counted. */
+class SpartnLogger {
+    public:
+        SpartnLogger() = default;
+        ~SpartnLogger();
+
+        SpartnLogger(const SpartnLogger &) = delete;
+        SpartnLogger &operator=(const SpartnLogger &) = delete;
+
+        // base_name gets "_<n>", "_<week>_<hour>" and ".bin" appended depending on the rotation
+        bool open(const std::string &base_name, const SpartnLogPolicy &policy);
+        void close();
+        bool is_open() const { return running; }
+
+        void log(const uint8_t *data, size_t size);
+
+        void print(std::ostream &os, const std::string &name) const;
+
+    private:
+        void write_loop();
+        void write_batch(const std::vector<char> &batch);
+        void write_block(const char *data, size_t size);
+        bool open_file(uint64_t gps_hour);
+        void close_file();
+        std::string file_name(uint64_t gps_hour) const;
+
+        std::string base_name;
+        SpartnLogPolicy policy;
+        size_t buffer_capacity = 0;
+
+        // Producer side, log() appends to active under lk_buffers
+        std::mutex lk_buffers;
+        std::condition_variable cv_writer;
+        std::vector<char> active;
+        std::vector<char> standby;
+        bool running = false;
+        std::thread writer_thread;
+
+        // Writer side
+        int fd = -1;
+        uint64_t file_bytes = 0;
+        uint64_t file_hour = 0;
+        unsigned int file_index = 0;
+        char *direct_block = nullptr; // aligned staging buffer with O_DIRECT
+        size_t direct_fill = 0;
+        size_t direct_capacity = 0;
+
+        std::atomic<uint64_t> records{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> drops{0};
+        std::atomic<uint64_t> write_errors{0};
+        std::atomic<uint64_t> files{0};
+        LatencyHistogram write_time;
+};
+
+bool parse_log_sync(const std::string &value, log_sync &sync);
+
+// "none", "hour" (GPS hour) or a size in MB
+bool parse_log_rotation(const std::string &value, SpartnLogPolicy &policy);
+
+#endif
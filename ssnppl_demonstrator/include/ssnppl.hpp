@@ -35,12 +35,31 @@
 #include "program_option.hpp"
 #include "mqtt.hpp"
 #include "SerialComm.hpp"
+#include "latency.hpp"
+#include "frame_scanner.hpp"
+#include "spartn_log.hpp"
+#include "replay.hpp"
+#include "rtcm3.hpp"
+#include "tx_link.hpp"
+#include "tile_cache.hpp"
+#include "motion.hpp"
+#include "position_trigger.hpp"
+#include "command_engine.hpp"
+#include "startup_trace.hpp"
+#include "metrics.hpp"
+#include "log.hpp"
+#include "queue.hpp"
 #include <thread>
 #include <queue>
-#include "PPL_PublicInterface.h" // PointPerfect Library
+#include "ppl_backend.hpp" // PointPerfect Library
+#include <memory>
+#include <map>
 #include <vector>
+#include <array>
 #include <condition_variable>
 #include <atomic>
+#include <future>
+#include <list>
 
 enum ssnppl_error
 {
@@ -50,15 +69,52 @@ enum ssnppl_error
     PPL_FAILED,
 };
 
+// Largest RTCM3 frame: header, 1023 bytes payload, CRC
+#define MAX_RTCM3_FRAME 1029
+
+// Serial backlog above which the RTCM of old epochs is thinned, twice that and the newest one is thinned too
+#define RTCM_TX_BACKLOG_LIMIT std::chrono::milliseconds(500)
+
+// Broker switch: longest wait for the new broker, SPARTN payloads remembered to drop the ones received twice
+#define MQTT_SWITCH_TIMEOUT std::chrono::seconds(30)
+#define MQTT_DEDUP_WINDOW 32
+#define MQTT_DEDUP_TAIL std::chrono::seconds(2)
+
+// How far ahead the localized service looks for the next tile and node, in seconds of travel
+#define PREFETCH_HORIZON 30.0f
+#define PREFETCH_STEPS 6
+
+// Receiver bytes as read from a channel, stamped when the read completed
+struct RcvrChunk {
+    std::vector<uint8_t> data;
+    latency_clock::time_point stamp;
+    frame_type type; // FRAME_TYPES for unframed data (LBand)
+};
+
+// PPL calls counted per return status
+enum ppl_call { PPL_CALL_KEY, PPL_CALL_SPARTN, PPL_CALL_AUX_SPARTN, PPL_CALL_RCVR, PPL_CALLS };
+#define PPL_STATUS_CODES 16 // higher status codes are counted with the last one
+
+// RTCM output of the PPL, with the arrival of the correction it comes from
+struct RtcmChunk {
+    std::vector<uint8_t> data;
+    latency_clock::time_point arrival;
+    latency_clock::time_point queued;
+    correction_source source;
+};
+
 class Ssnppl_demonstrator
 {
     
 private:
     // State struct
     ProgramOptions options;
+    log_level log_level_option = LEVEL_INFO;
     char *currentDynKey;
 
     std::string freqInfo = "";
+    std::string pending_frequency = ""; // requested while update_receiver is set, under lk_freq_info
+    std::mutex lk_freq_info; // freqInfo is read again when a channel is reconnected
     std::string keyInfo = "";
 
     std::atomic<bool> update_receiver{false};
@@ -67,33 +123,132 @@ private:
 
     ssnppl_error init_option(int argc, char *argv[]);
     void init_receiver();
+
+    // Startup: init_mqtt() runs on its own thread next to init_local() (ports, PPL, logs, receiver)
+    StartupTrace startup_trace;
+    bool rtk_fix_seen = false; // GGA are parsed for the first_rtk_fix milestone until then
+    ssnppl_error init_local();
+    ssnppl_error trace_phase(const std::string &name, const std::string &branch, const std::function<ssnppl_error()> &phase);
     ssnppl_error init_ppl();
+    std::unique_ptr<PplBackend> ppl;
+
+    // Serial Port, both channels share the io_service of the event driven ingest
+    boost::asio::io_service io_service;
+    SerialPort main_channel{io_service};
+    SerialPort lband_channel{io_service};
+
+    // Event driven ingest: one thread runs the io_service for both channels
+    void start_event_ingest();
+    void push_ephemeris_gga_data(const uint8_t *data, size_t size, latency_clock::time_point stamp);
+    void push_lband_data(const uint8_t *data, size_t size, latency_clock::time_point stamp);
+    std::thread io_service_thread;
 
-    // Serial Port
-    SerialPort main_channel;
-    SerialPort lband_channel;
+    // Replay of recorded logs instead of the receiver and MQTT (--replay)
+    bool replaying() const { return options.replay != "none"; }
+    void replay_input();
+    void push_replay_message(const uint8_t *data, size_t size);
+    std::thread replay_thread;
+    std::atomic<bool> replay_done{false};
 
-    // Ephemeris GGA thread
+    // Main channel recording for a later replay (--rcvr_capture)
+    SpartnLogger rcvr_capture;
+
+    // Main channel framing: NMEA and RTCM3 frames to PPL, replies to the console
+    void route_main_frame(const Frame &frame);
+    FrameScanner main_scanner{[this](const Frame &frame) { route_main_frame(frame); }};
+    latency_clock::time_point main_stamp;
+
+    // Ephemeris GGA thread (poll ingest)
     void read_ephemeris_gga_data();
     std::thread read_ephemeris_gga_data_thread;
-    std::queue<std::vector<uint8_t>> ephemeris_gga_queue;
-    std::mutex ephemeris_gga_mutex;
+    SpscRing<RcvrChunk> ephemeris_gga_queue{MAX_RECEIVER_QUEUE_SIZE, RING_DROP_OLDEST, [](RcvrChunk &slot) {
+        slot.data.reserve(MAX_RTCM3_FRAME);
+    }};
 
-    // LBand thread
+    // LBand thread (poll ingest)
     void read_lband_data();
     std::thread read_lband_data_thread;
-    std::queue<std::vector<uint8_t>> lband_queue;
-    std::mutex lband_queue_mutex;
+    SpscRing<RcvrChunk> lband_queue{MAX_LBAND_QUEUE_SIZE, RING_DROP_OLDEST, [](RcvrChunk &slot) {
+        slot.data.reserve(MAX_RCVR_DATA);
+    }};
+
+    // Heap allocations while handling SPARTN messages, with SSNPPL_ALLOC_COUNTERS
+    uint64_t spartn_path_allocations{0};
+    uint64_t spartn_path_messages{0};
+
+    BatchCounters ephemeris_gga_counters;
+    BatchCounters lband_counters;
+
+    // Time from the end of a channel read to the hand-off to PPL
+    LatencyHistogram ephemeris_gga_latency;
+    LatencyHistogram lband_latency;
+
+    // Metrics endpoint (--metrics_port), the collector only reads atomics
+    MetricsServer metrics{[this](std::ostream &os) { collect_metrics(os); }};
+    void collect_metrics(std::ostream &os);
+    std::atomic<uint64_t> main_bytes{0};
+    std::atomic<uint64_t> lband_bytes{0};
+    std::atomic<uint64_t> rtcm_bytes{0};
+    std::atomic<uint64_t> mqtt_server_switches{0};
+    std::atomic<uint64_t> tile_switches{0};
+    std::atomic<uint64_t> node_switches{0};
+    std::atomic<uint64_t> ppl_results[PPL_CALLS][PPL_STATUS_CODES] = {};
+    void count_ppl(ppl_call call, ppl_status status);
 
-    // PPL thread
+    // PPL thread, each wakeup handles every message queued since the previous one
     void handle_data();
+    bool has_incoming_data();
+    void notify_incoming_data();
+    void handle_mqtt_message(const struct mqttMessgae &message);
+    void handle_frequency_message(const struct mqttMessgae &message);
+    void handle_key_message(const struct mqttMessgae &message);
+    void handle_spartn_message(const struct mqttMessgae &message);
+    void handle_tile_message(const struct mqttMessgae &message);
+    void handle_ephemeris_gga_data(const RcvrChunk &frame);
+    void handle_lband_data(const RcvrChunk &chunk);
 
     // Send RTCM thread
     void write_rtcm();
     std::thread write_rtcm_thread;
-    std::queue<std::vector<uint8_t>> rtcm_queue;
-    std::mutex rtcm_queue_mutex;
+    void push_rtcm(const uint8_t *data, size_t size, latency_clock::time_point arrival, correction_source source);
+    SpscRing<RtcmChunk> rtcm_queue{MAX_RTCM_QUEUE_SIZE, RING_DROP_OLDEST, [](RtcmChunk &slot) {
+        slot.data.reserve(PPL_RTCM_BUFFER_SIZE);
+    }};
+
+    // The pending chunks are coalesced into one write, their stamps are kept for the latency
+    struct BatchedChunk {
+        latency_clock::time_point arrival;
+        correction_source source;
+    };
+    std::vector<uint8_t> rtcm_batch;
+    BatchedChunk rtcm_batch_chunks[MAX_RTCM_QUEUE_SIZE];
+    SerialTxModel rtcm_tx;
+    std::atomic<uint64_t> rtcm_writes{0};
+    std::atomic<uint64_t> rtcm_batched_chunks{0};
+    std::atomic<uint64_t> rtcm_stale_drops{0};
+    CorrectionLatency correction_latency;
+    std::mutex lk_rtcm;
     std::condition_variable cv_rtcm;
+    void wake_rtcm_writer();
+    Rtcm3Stats rtcm_out_stats;
+
+    // Receiver commands sent by write_rtcm(), replies come from route_main_frame()
+    CommandEngine command_engine{[this](const std::string &command) {
+        if (!replaying())
+            main_channel.sync_write(command);
+    }, [this] { wake_rtcm_writer(); }};
+    void request_lband_reconfiguration(const std::string &frequency);
+    void reconfigure_lband(const std::string &frequency);
+    void finish_lband_reconfiguration();
+    void queue_receiver_config();
+    void identify_main_port();
+    void reconfigure_after_reconnect(bool main_channel_lost);
+
+    // RTCM to a file or pty instead of the receiver (--rtcm_output)
+    int rtcm_output_fd = -1;
+    uint64_t rtcm_output_drops = 0;
+    ssnppl_error init_rtcm_output();
+    void write_receiver(const uint8_t *data, size_t size);
 
     std::condition_variable_any cv_incoming_data;
     std::mutex lk_incoming_data;
@@ -104,27 +259,72 @@ private:
     // MQTT
     struct mosquitto *mosq_client = nullptr;
     UserData userData;
+    // Handler of each topic ID, topics are bound to their ID in userData.topics when subscribed
+    typedef std::function<void(const struct mqttMessgae &)> topic_handler;
+    std::array<topic_handler, TOPIC_IDS> topic_handlers;
     ssnppl_error init_mqtt();
-    ssnppl_error switch_mqtt_server(std::string new_mqtt_server);
+    void init_topic_handlers();
+    struct mosquitto *new_mqtt_client();
+    void stop_mqtt_client(struct mosquitto *client);
+    ssnppl_error switch_mqtt_server(const std::string &new_mqtt_server, const std::string &previous_node_topic);
+
+    /*  Make-before-break broker switch: the previous client keeps delivering until the first SPARTN
+        of the new one, the SPARTN received twice meanwhile is dropped. */
+    struct mosquitto *mosq_draining = nullptr;
+    std::string draining_node_topic;
+    std::list<std::future<void>> stopping_clients; // see stop_mqtt_client()
+    latency_clock::time_point switch_started;
+    latency_clock::time_point last_spartn;
+    latency_clock::time_point dedup_until;
+    std::array<uint64_t, MQTT_DEDUP_WINDOW> recent_spartn{};
+    size_t recent_spartn_next = 0;
+    LatencyHistogram mqtt_switch_duration; // switch to the first SPARTN of the new broker
+    LatencyHistogram mqtt_switch_gap;      // last SPARTN before the first one of the new broker
+    std::atomic<uint64_t> mqtt_duplicates{0};
+    std::atomic<uint64_t> mqtt_switch_timeouts{0};
+    bool duplicate_spartn(const struct mqttMessgae &message);
+    void finish_mqtt_switch(latency_clock::time_point first_spartn);
+    void check_mqtt_switch();
 
     // SPARTN LOG
-    std::ofstream SPARTN_file_Ip;
-    std::ofstream SPARTN_file_Lb;
-    void init_SPARTN_LOG();
+    SpartnLogPolicy SPARTN_log_policy;
+    SpartnLogger SPARTN_file_Ip;
+    SpartnLogger SPARTN_file_Lb;
+    ssnppl_error init_SPARTN_LOG();
 
     // Localized Service
-    std::vector<std::string> tile_dict;
+    std::shared_ptr<const TileDict> current_tile;
+    TileCache tile_cache;
+    std::atomic<uint64_t> tile_cache_hits{0};
     int tile_level{2};
-    float latitude_threshold{0}; 
-    float longitude_threshold{0};
+    PositionTrigger position_trigger;
+    float tile_latitude{0}; // position the current tile was computed from
+    float tile_longitude{0};
+    std::atomic<uint64_t> position_recomputes{0};
+    std::atomic<uint64_t> tile_holds{0}; // switches avoided by the hysteresis
+    std::atomic<uint64_t> node_holds{0};
     float latitude{0};
     float longitude{0};
-    std::string nodeprefix ; 
 
+    // Prefetch: the dict of the next tile and the SPARTN of the next node are subscribed before they are needed
+    MotionPredictor motion;
+    std::string prefetch_tile_topic;
+    std::string warm_node_topic;
+    latency_clock::time_point node_switch_at;
+    bool node_switch_pending = false;
+    LatencyHistogram node_switch_gap; // node switch to its first SPARTN message
+    std::atomic<uint64_t> tile_prefetches{0};
+    std::atomic<uint64_t> tile_prefetch_hits{0};
+    std::atomic<uint64_t> warm_node_switches{0};
+
+    void process_gga(const std::string &sentence);
     void process_new_position () noexcept;
     void process_new_node() noexcept ;
     std::string new_Node_Topic () noexcept;
     std::string new_Tile_Topic () noexcept;
+    void apply_tile(std::shared_ptr<const TileDict> dict);
+    void prefetch_ahead();
+    void warm_node(const std::string &node_topic);
 
     
 public:
@@ -0,0 +1,79 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __STARTUP_TRACE__
+#define __STARTUP_TRACE__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include "latency.hpp"
+
+/*  Startup phases and milestones (first dynamic key, first RTCM ...) timed from the creation
+    of the trace. Phases of parallel branches may overlap, record() and mark() are thread-safe. */
+class StartupTrace {
+    public:
+        StartupTrace() : origin(latency_clock::now()) {}
+
+        void record(const std::string &name, const std::string &branch, latency_clock::time_point start, bool ok);
+
+        // Only the first mark of a milestone is kept
+        void mark(const std::string &milestone);
+
+        std::string json() const;
+        bool write(const std::string &path) const;
+        void print(std::ostream &os) const;
+
+    private:
+        struct Phase {
+            std::string name;
+            std::string branch;
+            int64_t start_us;
+            int64_t duration_us;
+            bool ok;
+        };
+        struct Milestone {
+            std::string name;
+            int64_t at_us;
+        };
+
+        int64_t since_origin(latency_clock::time_point t) const {
+            return std::chrono::duration_cast<std::chrono::microseconds>(t - origin).count();
+        }
+
+        latency_clock::time_point origin;
+        mutable std::mutex lk_trace;
+        std::vector<Phase> phases;
+        std::vector<Milestone> milestones;
+};
+
+#endif
@@ -0,0 +1,114 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __TILE_CACHE__
+#define __TILE_CACHE__
+
+#include "node_index.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Node dictionary of a tile, from its /dict message
+struct TileDict {
+    std::string nodeprefix;
+    std::string endpoint;
+    NodeIndex nodes;
+    std::time_t received = 0; // wall clock, the age survives a restart
+};
+
+/*  Parsed tile dictionaries of the localized service by /dict topic, so that coming back to a tile
+    is answered without subscribing to its dictionary again. The least recently used dictionary is
+    evicted beyond the capacity and a dictionary older than the TTL (0 for none) is not returned, the
+    tile is then downloaded again. With a file, the cache is loaded at startup and a writer thread
+    rewrites it after each new dictionary, the dispatch thread only takes a snapshot of the entries.
+    Used from the dispatch thread only, the counters may be read from any thread. */
+class TileCache {
+    public:
+        TileCache() = default;
+        ~TileCache();
+
+        TileCache(const TileCache &) = delete;
+        TileCache &operator=(const TileCache &) = delete;
+
+        /*  Sets the limits and loads the persisted copy, path "none" keeps the cache in memory only.
+            Returns the number of dictionaries loaded. */
+        size_t open(const std::string &path, size_t capacity, long ttl_seconds);
+        // Writes the last snapshot not written yet and stops the writer thread
+        void close();
+
+        // Dictionary of the topic, nullptr if unknown or expired
+        std::shared_ptr<const TileDict> find(const std::string &topic);
+        void insert(const std::string &topic, std::shared_ptr<const TileDict> dict);
+
+        size_t size() const { return entry_count.load(std::memory_order_relaxed); }
+        uint64_t evictions() const { return evicted.load(std::memory_order_relaxed); }
+        uint64_t expirations() const { return expired.load(std::memory_order_relaxed); }
+        uint64_t write_errors() const { return failed_writes.load(std::memory_order_relaxed); }
+
+    private:
+        typedef std::list<std::pair<std::string, std::shared_ptr<const TileDict>>> lru_list;
+        // Entries in file order, the most recently used last
+        typedef std::vector<std::pair<std::string, std::shared_ptr<const TileDict>>> snapshot;
+
+        void erase(std::map<std::string, lru_list::iterator>::iterator it);
+        bool expired_at(const TileDict &dict, std::time_t now) const { return ttl > 0 && now - dict.received >= ttl; }
+        void write_loop();
+        bool save(const snapshot &tiles) const;
+
+        size_t capacity = 1;
+        long ttl = 0;
+        std::string path = "none";
+
+        lru_list entries; // most recently used first
+        std::map<std::string, lru_list::iterator> by_topic;
+
+        // insert() hands the latest snapshot to the writer thread, older ones are never written
+        std::thread writer_thread;
+        std::mutex lk_writer;
+        std::condition_variable cv_writer;
+        std::unique_ptr<snapshot> pending;
+        bool running = false;
+
+        std::atomic<size_t> entry_count{0};
+        std::atomic<uint64_t> evicted{0};
+        std::atomic<uint64_t> expired{0};
+        std::atomic<uint64_t> failed_writes{0};
+};
+
+#endif
@@ -0,0 +1,119 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __TRANSPORT__
+#define __TRANSPORT__
+
+#include <boost/asio.hpp>
+#include <boost/asio/serial_port.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <string>
+#include <chrono>
+#include <functional>
+
+// Delay before reopening a lost connection, doubled after each failed attempt
+#define TRANSPORT_BACKOFF_MIN std::chrono::milliseconds(100)
+#define TRANSPORT_BACKOFF_MAX std::chrono::seconds(5)
+
+// Bound on a TCP connection attempt, reconnection runs on the io_service thread shared by both channels
+#define TRANSPORT_CONNECT_TIMEOUT std::chrono::milliseconds(500)
+
+/*  Byte stream to the receiver used by SerialPort: a serial device or a TCP connection to an IP port.
+    open() may be called again after close() or an error to reconnect, SerialPort does it with a backoff. */
+class Transport {
+    public:
+        typedef std::function<void(const boost::system::error_code &error, size_t bytes_transferred)> read_handler;
+
+        virtual ~Transport() {}
+
+        virtual std::string name() const = 0;
+        virtual bool open(boost::system::error_code &error) = 0;
+        virtual void close() = 0;
+        virtual bool is_open() const = 0;
+
+        virtual void async_read_some(uint8_t *data, size_t size, read_handler handler) = 0;
+        virtual size_t read_some(uint8_t *data, size_t size, boost::system::error_code &error) = 0;
+        virtual void write(const uint8_t *data, size_t size, boost::system::error_code &error) = 0;
+
+        // Waits up to timeout for bytes to read, without reading them
+        virtual bool wait_readable(std::chrono::milliseconds timeout) = 0;
+};
+
+class SerialTransport : public Transport {
+    public:
+        SerialTransport(boost::asio::io_service &io_service, const std::string &device_path, unsigned int baud_rate)
+            : device_path(device_path), baud_rate(baud_rate), port(io_service) {}
+
+        std::string name() const override { return device_path; }
+        bool open(boost::system::error_code &error) override;
+        void close() override;
+        bool is_open() const override { return port.is_open(); }
+
+        void async_read_some(uint8_t *data, size_t size, read_handler handler) override;
+        size_t read_some(uint8_t *data, size_t size, boost::system::error_code &error) override;
+        void write(const uint8_t *data, size_t size, boost::system::error_code &error) override;
+        bool wait_readable(std::chrono::milliseconds timeout) override;
+
+    private:
+        std::string device_path;
+        // /dev/serial/by-id link of the device found at the first open, it survives a re-enumeration as another ttyACM
+        std::string stable_path;
+        unsigned int baud_rate;
+        boost::asio::serial_port port;
+};
+
+// Septentrio IP port (IP10-IP17 are given out on connection to port 28784, IPS1-IPS5 are configured with siss)
+class TcpTransport : public Transport {
+    public:
+        TcpTransport(boost::asio::io_service &io_service, const std::string &host, const std::string &port)
+            : host(host), port(port), io_service(io_service), socket(io_service) {}
+
+        std::string name() const override { return host + ":" + port; }
+        bool open(boost::system::error_code &error) override;
+        void close() override;
+        bool is_open() const override { return socket.is_open(); }
+
+        void async_read_some(uint8_t *data, size_t size, read_handler handler) override;
+        size_t read_some(uint8_t *data, size_t size, boost::system::error_code &error) override;
+        void write(const uint8_t *data, size_t size, boost::system::error_code &error) override;
+        bool wait_readable(std::chrono::milliseconds timeout) override;
+
+    private:
+        bool connect(const boost::asio::ip::tcp::endpoint &endpoint, boost::system::error_code &error);
+
+        std::string host;
+        std::string port;
+        boost::asio::io_service &io_service;
+        boost::asio::ip::tcp::socket socket;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#ifndef __TX_LINK__
+#define __TX_LINK__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include "latency.hpp"
+
+// Utilization is measured over windows of this length
+#define TX_LINK_WINDOW std::chrono::seconds(5)
+
+/*  Transmit side of the serial link to the receiver, modeled from the configured baud rate (8N1, 10 bits per byte):
+    each write keeps the line busy for its bytes after the previous ones are out. On a USB CDC port the real
+    link is faster than its baud rate, the model is then an upper bound.
+    Updated by the writer thread only, the getters can be called from any thread. */
+class SerialTxModel {
+    public:
+        void set_baud_rate(unsigned int baud_rate) { bytes_per_second = baud_rate / 10; }
+        bool modeled() const { return bytes_per_second > 0; }
+
+        void on_write(size_t bytes, latency_clock::time_point now) {
+            if (!modeled())
+                return;
+            latency_clock::duration sending = std::chrono::duration_cast<latency_clock::duration>(
+                std::chrono::duration<double>(double(bytes) / bytes_per_second));
+            busy_until = std::max(busy_until, now) + sending;
+            window_busy += sending;
+            busy_us.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(sending).count(), std::memory_order_relaxed);
+            tick(now);
+        }
+
+        // Time until the bytes already written are out of the line
+        latency_clock::duration backlog(latency_clock::time_point now) const {
+            return busy_until > now ? busy_until - now : latency_clock::duration::zero();
+        }
+
+        // Closes the utilization window once it has elapsed
+        void tick(latency_clock::time_point now) {
+            if (!modeled())
+                return;
+            in_flight.store(uint64_t(std::chrono::duration<double>(backlog(now)).count() * bytes_per_second), std::memory_order_relaxed);
+            if (now - window_start < TX_LINK_WINDOW)
+                return;
+            double share = std::chrono::duration<double>(window_busy).count() / std::chrono::duration<double>(now - window_start).count();
+            utilization_permille.store(uint32_t(std::min(share, 1.0) * 1000), std::memory_order_relaxed);
+            window_start = now;
+            window_busy = latency_clock::duration::zero();
+        }
+
+        // Share of the last window the line was sending, in percent
+        double utilization() const { return utilization_permille.load(std::memory_order_relaxed) / 10.0; }
+        uint64_t bytes_in_flight() const { return in_flight.load(std::memory_order_relaxed); }
+        uint64_t busy_total_us() const { return busy_us.load(std::memory_order_relaxed); }
+
+    private:
+        unsigned int bytes_per_second = 0;
+        latency_clock::time_point busy_until;
+        latency_clock::time_point window_start = latency_clock::now();
+        latency_clock::duration window_busy = latency_clock::duration::zero();
+
+        std::atomic<uint32_t> utilization_permille{0};
+        std::atomic<uint64_t> in_flight{0};
+        std::atomic<uint64_t> busy_us{0};
+};
+
+#endif
@@ -48,9 +48,11 @@ std::vector<std::string> split(const std::string &str, char separator);
 
 bool is_empty(const uint8_t *arr, std::size_t size);
 
-unsigned int getbitu(const unsigned char *buff, int pos, int len);
+// CRC-24Q of RTCM3 frames (preamble to end of payload)
+uint32_t crc24q(const uint8_t *data, size_t size);
 
-std::vector<int> identifyRTCM3MessageIDs(const uint8_t *buffer, size_t bufferSize);
+// CRC-16-CCITT of SBF blocks (ID to end of block)
+uint16_t crc16_ccitt(const uint8_t *data, size_t size);
 
 float distanceBetweenLocations(const float lat1 , const float lon1 ,const float lat2 , const float lon2);
 
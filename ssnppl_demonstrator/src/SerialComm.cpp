@@ -30,52 +30,79 @@
 // ****************************************************************************
 
 #include "SerialComm.hpp"
+#include "log.hpp"
 
 /*Opening a serial port with the specified device path and baud rate.*/
-void SerialPort::open_serial_port (std::string device_path, unsigned int baud_rate)
+bool SerialPort::open_serial_port (std::string device_path, unsigned int baud_rate)
 {   
-
-    try
+    transport.reset(new SerialTransport(io_service, device_path, baud_rate));
+    if (!transport->open(error))
     {
-        serial_port.reset();
-        serial_port = serial_port_ptr(new boost::asio::serial_port(io_service));
-        serial_port->open(device_path, error);
+        std::cout << "There was an error trying to initialize the serial port " << device_path << "." << std::endl;
+        std::cout << "error.message() >> " << error.message().c_str() << std::endl;
+        return false;
+    }
 
-        if (error) 
-        {
-            std::cout << "There was an error trying to initialize the serial port." << std::endl;
-            std::cout << "error.message() >> " << error.message().c_str() << std::endl;
-            throw -3;
-        }
+    std::cout << "The " << device_path << " serial port was opened correctly." << std::endl;  
 
-        // set options
-        serial_port->set_option(boost::asio::serial_port_base::baud_rate(baud_rate));
-        serial_port->set_option(boost::asio::serial_port_base::character_size(8));
-        serial_port->set_option(boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one));
-        serial_port->set_option(boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none));
-        serial_port->set_option(boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none));    
+    return true;
+}
 
-    }
-    catch (int error)
+bool SerialPort::open_tcp_port(const std::string &host, const std::string &port)
+{
+    transport.reset(new TcpTransport(io_service, host, port));
+    if (!transport->open(error))
     {
-        std::cout << "error = " << error;
-        throw -1;
+        std::cout << "Cannot connect to " << transport->name() << ": " << error.message() << std::endl;
+        return false;
     }
-    catch (const std::exception &e)
+
+    std::cout << "Connected to " << transport->name() << "." << std::endl;
+    return true;
+}
+
+std::string SerialPort::identifyPort(std::chrono::milliseconds timeout)
+{
+    // The receiver answers an empty line with its prompt, e.g. "IP10>"
+    sync_write("\x0D");
+
+    std::string received;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline)
     {
-        std::cout << "e.what() = " << e.what() << std::endl;
-        throw -2;
+        std::chrono::milliseconds left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (!transport->wait_readable(left))
+            break;
+
+        uint8_t prompt_buffer[256];
+        boost::system::error_code read_error;
+        size_t size = transport->read_some(prompt_buffer, sizeof(prompt_buffer), read_error);
+        if (read_error)
+            break;
+        received.append((const char *)prompt_buffer, size);
+
+        size_t prompt = received.find('>');
+        if (prompt != std::string::npos && prompt >= 4)
+            return findUsedPort(received.substr(prompt - 4, 4));
     }
+    return "";
+}
 
-    std::cout << "The " << device_path << " serial port was opened correctly." << std::endl;  
-
-    return;
+void SerialPort::close_serial_port(void)
+{
+    boost::mutex::scoped_lock lock (mutex);
+    closing = true;
+    reconnect_timer.cancel();
+    if (transport)
+        transport->close();
 }
 
 /*  The async_read_some function initiates an asynchronous read operation on the serial port. 
     This function returns immediately, allowing the program to continue executing other tasks while the read operation is in progress. 
-    When data is received from the serial port, the data_received function is called to process the received data. */
-void SerialPort::async_read_some (void)
+    When data is received from the serial port, the data_received function is called to process the received data
+    and the handler is called with the bytes read. The io_service is not run here: the owner runs it, so a single
+    thread can serve several ports. */
+void SerialPort::async_read_some (data_handler handler)
 {
     /*  
         boost::mutex::scoped_lock lock (mutex);
@@ -88,45 +115,32 @@ void SerialPort::async_read_some (void)
 
     std::cout << "Asynchronous reading started." << std::endl; 
 
-    try
+    on_data = handler;
+    if (!transport)
     {
-        if (!serial_port->is_open())
-        {
-            std::cout << "The serial port is closed when reading asynchronously. Throwing exception -2." << std::endl; 
-            throw -2;
-        }
-
-        serial_port->async_read_some(
-            boost::asio::buffer(read_buffer, MAX_RCVR_DATA),
-            boost::bind(
-                &SerialPort::data_received,
-                this, boost::asio::placeholders::error, 
-                boost::asio::placeholders::bytes_transferred
-            )
-        );
-        
-        /* 
-            boost::thread t(boost::bind(&boost::asio::io_service::run, &io_service));
-
-            creates a new thread of execution that runs the boost::asio::io_service::run function. 
-            This function is used to start the event loop of the io_service object, 
-            which is responsible for running asynchronous operations. 
-
-            The boost::bind function is used to bind the &io_service argument to the run function. 
-            This creates a function object that can be passed as an argument to the boost::thread constructor. 
-            The boost::thread constructor creates a new thread of execution that runs the run function with the io_service object as an argument.   
-        */
-        boost::thread t(boost::bind(&boost::asio::io_service::run, &io_service));
+        std::cout << "The serial port is not opened, nothing to read asynchronously." << std::endl; 
+        return;
     }
-    catch (const std::exception &e)
+    if (transport->is_open())
     {
-        std::cout << "e.what() = " << e.what();
-        throw -1;
+        start_async_read();
+        return;
     }
 
-    //std::cout << "Asynchronous reading ended." << std::endl; 
+    // Lost before the reading started, e.g. by a failed write of the configuration commands
+    lock.unlock();
+    schedule_reconnect();
+}
 
-    return;
+void SerialPort::start_async_read()
+{
+    transport->async_read_some(read_buffer, MAX_RCVR_DATA,
+        boost::bind(
+            &SerialPort::data_received,
+            this, boost::asio::placeholders::error, 
+            boost::asio::placeholders::bytes_transferred
+        )
+    );
 }
 
 /*  Once the data_received function has finished processing the received data, 
@@ -135,96 +149,160 @@ void SerialPort::async_read_some (void)
     from the serial port and process it as it becomes available. */
 void SerialPort::data_received(const boost::system::error_code& error, size_t bytes_transferred)
 {
-       /*  
-        boost::mutex::scoped_lock lock (mutex);
+    if (closing)
+        return;
+
+    if (error) 
+    {            
+        // EOF or EIO when a USB cable is pulled, aborted when a failed write closed the transport
+        LOG_ERROR("Read error on " << transport->name() << ": " << error.message());
+        schedule_reconnect();
+        return;
+    }  
+
+    // determine whether the serial_port object has been initialized or if it is in a valid state and check if serial port is opened.
+    if (!transport->is_open())
+    {
+        LOG_ERROR("Serial port is not open");
+        return;
+    }
 
-        Creates a scoped_lock object named lock that acquires the mutex object when it is constructed. 
-        This ensures that only one thread can execute the code protected by the mutex at a time. 
-        When the lock object goes out of scope, the mutex is automatically released, allowing other threads to acquire it.
-    */
+    // The handler runs without the mutex so that a concurrent sync_write is not held up by the consumer
+    if (bytes_transferred > 0 && on_data)
+        on_data(read_buffer, bytes_transferred);
+
+    // prevent io_service from returning due to lack of work    
     boost::mutex::scoped_lock lock (mutex); // prevent multiple threads
+    start_async_read();
 
-    //std::cout << "Asynchronous callback started." << std::endl; 
+    return;
+}
 
-    try
-    {
-        // determine whether the serial_port object has been initialized or if it is in a valid state and check if serial port is opened.
-        if (serial_port.get() == NULL || !serial_port->is_open())
+void SerialPort::schedule_reconnect()
+{
+    boost::mutex::scoped_lock lock (mutex);
+    transport->close();
+    disconnected();
+
+    LOG_INFO("Reconnecting to " << transport->name() << " in " << backoff.count() << " ms");
+    reconnect_timer.expires_from_now(backoff);
+    reconnect_timer.async_wait([this](const boost::system::error_code &error)
+                               {
+        if (error || closing)
+            return;
+
+        boost::mutex::scoped_lock lock (mutex);
+        if (try_reconnect())
         {
-            std::cout << "Serial port is not open" << std::endl; 
-            throw -2;
+            // Before the reading resumes, so that the handler can read the receiver prompt
+            lock.unlock();
+            if (on_reconnect)
+                on_reconnect();
+            lock.lock();
+            if (!closing)
+                start_async_read();
+            return;
         }
-        if (error) 
-        {            
-            std::cout << "There was an error while checking the serial port." << std::endl;
-            std::cout << "error.message() >> " << error.message().c_str() << std::endl;
-            throw -3;
-        }  
-                 
-        for (unsigned int i = 0; i < bytes_transferred; ++i) {
-            serial_read_data += read_buffer[i];
-        }     
-
-        //std::cout << "Bytes_transferred: \n" << bytes_transferred << std::endl;
-        //std::cout << "\nSerial Read Data:\n" << serial_read_data  << std::endl;
-
-        serial_data_read_complete = true;
-    }
-    catch (const std::exception &e)
+        lock.unlock();
+        schedule_reconnect(); });
+}
+
+// Called with the mutex held
+void SerialPort::disconnected()
+{
+    if (disconnected_at == std::chrono::steady_clock::time_point())
+        disconnected_at = std::chrono::steady_clock::now();
+}
+
+// Called with the mutex held
+bool SerialPort::try_reconnect()
+{
+    boost::system::error_code open_error;
+    if (!transport->open(open_error))
     {
-        std::cout << "e.what() = " << e.what();
-        throw -1;
+        backoff = std::min<std::chrono::milliseconds>(backoff * 2, TRANSPORT_BACKOFF_MAX);
+        return false;
     }
 
-    // prevent io_service from returning due to lack of work    
-    serial_port->async_read_some(
-        boost::asio::buffer(read_buffer, MAX_RCVR_DATA),
-        boost::bind(
-            &SerialPort::data_received,
-            this, boost::asio::placeholders::error, 
-            boost::asio::placeholders::bytes_transferred
-        )
-    );
+    uint64_t outage_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - disconnected_at).count();
+    disconnected_at = std::chrono::steady_clock::time_point();
+    outage_total_us += outage_us;
+    if (outage_us > outage_max_us)
+        outage_max_us = outage_us;
+    reconnect_count++;
+    backoff = TRANSPORT_BACKOFF_MIN;
 
-    return;
+    LOG_INFO("Reconnected to " << transport->name() << " after " << outage_us / 1000 << " ms");
+    return true;
 }
 
-size_t SerialPort::sync_read()
+size_t SerialPort::sync_read(uint8_t *data, size_t size)
 {
 
     boost::mutex::scoped_lock lock (mutex); // prevent multiple threads
 
-    // Read data from the serial port into the read_sync_buffer array
-    size_t bytes_transferred = serial_port->read_some(boost::asio::buffer(read_sync_buffer));
+    if (!transport)
+        return 0;
+
+    // Lost connection: one reopening attempt per call after the backoff, nothing read meanwhile
+    if (!transport->is_open())
+    {
+        std::chrono::milliseconds wait = backoff;
+        lock.unlock();
+        std::this_thread::sleep_for(wait);
+        lock.lock();
+        if (closing || !try_reconnect())
+            return 0;
+
+        lock.unlock();
+        if (on_reconnect)
+            on_reconnect();
+        lock.lock();
+    }
 
-    /*  Copy the data from the read_sync_buffer array into the serial_read_data string.
+    // Read data from the serial port into the caller's buffer, nothing is copied or cleared here
+    boost::system::error_code read_error;
+    size_t bytes_transferred = transport->read_some(data, size, read_error);
+    if (read_error)
+    {
+        // EOF or EIO when a USB cable is pulled, the next call reopens the port
+        LOG_ERROR("Read error on " << transport->name() << ": " << read_error.message());
+        transport->close();
+        disconnected();
+        return 0;
+    }
 
-        For example, if read_sync_buffer is an array of size 256 and bytes_transferred is 5, 
-        then read_sync_buffer + bytes_transferred will be a pointer to the element at the 5th 
-        position within the array (i.e., read_sync_buffer[4]). This means that only the first 5 
-        elements of the read_sync_buffer array will be copied into the serial_read_data string. */
-    
-    serial_read_data.assign(read_sync_buffer, read_sync_buffer + bytes_transferred);
     return bytes_transferred;
 
 }
 
 void SerialPort::sync_write(const std::string& data)
 {
-    boost::mutex::scoped_lock lock (mutex); // prevent multiple threads
-
-    // Write the data to the serial port
-    boost::asio::write(*serial_port, boost::asio::buffer(data));
-
-    // Wait 1 second
-    //std::this_thread::sleep_for(std::chrono::seconds(1));
+    sync_write((const uint8_t *)data.data(), data.size());
 }
 
 void SerialPort::sync_write(const uint8_t *data, size_t size)
 {
     boost::mutex::scoped_lock lock (mutex); // prevent multiple threads
 
-    boost::asio::write(*serial_port, boost::asio::buffer(data, size));
+    // While a lost connection is being reopened the data is dropped, corrections are only useful fresh
+    if (!transport || !transport->is_open())
+    {
+        write_drops++;
+        return;
+    }
+
+    boost::system::error_code write_error;
+    transport->write(data, size, write_error);
+    if (write_error)
+    {
+        write_drops++;
+
+        // The pending read fails once the transport is closed and starts the reconnection
+        LOG_LIMITED(LEVEL_ERROR, "Write error on " << transport->name() << ": " << write_error.message());
+        transport->close();
+        disconnected();
+    }
 }
 
 std::string SerialPort::findUsedPort(const std::string& str)
@@ -262,7 +340,7 @@ std::string SerialPort::findUsedPort(const std::string& str)
 void SerialPort::setCmdInputMode()
 {
     // Write the data to the serial port
-    boost::asio::write(*serial_port, boost::asio::buffer("\x0DSSSSSSSSSSSSSSSSSSS\x0D\x0D"));
+    sync_write("\x0DSSSSSSSSSSSSSSSSSSS\x0D\x0D");
 
     // Wait 1 second
     std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -271,7 +349,7 @@ void SerialPort::setCmdInputMode()
 void SerialPort::setDefaultConfig()
 {
     // Write the data to the serial port
-    boost::asio::write(*serial_port, boost::asio::buffer("eccf, RxDefault, current\x0D"));
+    sync_write("eccf, RxDefault, current\x0D");
 
     // Wait 1 second
     std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -0,0 +1,179 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "command_engine.hpp"
+#include "log.hpp"
+#include <iomanip>
+#include <cctype>
+
+// Command as printed in the logs, without the terminating <CR>
+static std::string printable(const std::string &command)
+{
+    size_t end = command.find_last_not_of("\r\n");
+    return command.substr(0, end == std::string::npos ? 0 : end + 1);
+}
+
+// The receiver echoes the command in its reply: "$R: sdio, USB1, ..." or "$R? sdio: Argument ..."
+static bool reply_matches(const std::string &command, const char *reply, size_t size)
+{
+    size_t pos = 3;
+    while (pos < size && reply[pos] == ' ')
+        pos++;
+
+    size_t length = command.find_first_of(", \r");
+    if (length == std::string::npos)
+        length = command.size();
+    if (length == 0 || pos + length > size)
+        return false;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (std::tolower((unsigned char)reply[pos + i]) != std::tolower((unsigned char)command[i]))
+            return false;
+    }
+    return pos + length == size || !std::isalnum((unsigned char)reply[pos + length]);
+}
+
+void CommandEngine::queue(const std::string &command, command_done done, latency_clock::duration timeout)
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_commands);
+        pending.push_back(Command{command, true, timeout, done, 1});
+    }
+    wake();
+}
+
+void CommandEngine::queue_without_reply(const std::string &command, latency_clock::duration settle)
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_commands);
+        pending.push_back(Command{command, false, settle, nullptr, 1});
+    }
+    wake();
+}
+
+void CommandEngine::on_reply(const char *reply, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_commands);
+        if (!in_flight || !current.expects_reply || replied)
+            return;
+
+        // Late reply to a command that already timed out
+        if (!reply_matches(current.text, reply, size))
+            return;
+
+        replied = true;
+        reply_error = size > 2 && reply[2] == '?';
+        replied_at = latency_clock::now();
+        reply_time.record_since(sent_at);
+    }
+    wake();
+}
+
+bool CommandEngine::ready()
+{
+    std::lock_guard<std::mutex> lock(lk_commands);
+    if (in_flight)
+        return replied || latency_clock::now() >= deadline;
+    return !pending.empty();
+}
+
+latency_clock::time_point CommandEngine::poll()
+{
+    std::unique_lock<std::mutex> lock(lk_commands);
+    latency_clock::time_point now = latency_clock::now();
+
+    if (in_flight)
+    {
+        if (!replied && now < deadline)
+            return deadline;
+
+        bool ok = current.expects_reply ? replied && !reply_error : true;
+        if (current.expects_reply && !replied)
+        {
+            timeouts++;
+            LOG_WARN("No reply from the receiver to: " << printable(current.text));
+        }
+        else if (reply_error)
+        {
+            errors++;
+            LOG_WARN("Receiver rejected: " << printable(current.text));
+        }
+        else if (current.expects_reply)
+        {
+            LOG_INFO("Receiver accepted in "
+                     << std::chrono::duration_cast<std::chrono::milliseconds>(replied_at - sent_at).count()
+                     << " ms: " << printable(current.text));
+        }
+
+        in_flight = false;
+        if (!ok && current.attempts <= COMMAND_RETRIES)
+        {
+            // Sent again before anything queued after it
+            retries++;
+            current.attempts++;
+            pending.push_front(current);
+        }
+        else if (current.done)
+        {
+            command_done done = current.done;
+            lock.unlock();
+            done(ok);
+            lock.lock();
+        }
+    }
+
+    if (pending.empty())
+        return latency_clock::time_point::max();
+
+    current = pending.front();
+    pending.pop_front();
+    in_flight = true;
+    replied = false;
+    reply_error = false;
+    sent_at = latency_clock::now();
+    deadline = sent_at + current.timeout;
+    std::string text = current.text;
+    lock.unlock();
+
+    // The reply can only be matched once the state above is set
+    writer(text);
+    sent++;
+    return deadline;
+}
+
+void CommandEngine::print(std::ostream &os, const std::string &name) const
+{
+    os << "  *" << std::left << std::setw(24) << name << std::right
+       << "sent=" << sent << " errors=" << errors << " timeouts=" << timeouts << " retries=" << retries << std::endl;
+    reply_time.print(os, name + " reply");
+}
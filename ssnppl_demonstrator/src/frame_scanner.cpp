@@ -0,0 +1,203 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "frame_scanner.hpp"
+#include "utils.hpp"
+#include "rtcm3.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+void FrameScanner::feed(const uint8_t *data, size_t size)
+{
+    // Complete the pending frame first. Only the bytes it needs are copied, the rest is scanned in place.
+    while (size > 0 && pending_size > 0)
+    {
+        size_t n = std::min(size, (size_t)FRAME_BUFFER_SIZE - pending_size);
+
+        if (pending_need > pending_size)
+            n = std::min(n, pending_need - pending_size);
+        else if (pending[0] == '$' && pending_size >= 2 && pending[1] != '@')
+        {
+            const void *eol = std::memchr(data, '\n', n);
+            if (eol != nullptr)
+                n = (const uint8_t *)eol - data + 1;
+        }
+        else
+            n = std::min(n, (size_t)8); // header of a binary frame not complete yet
+
+        std::memcpy(pending + pending_size, data, n);
+        pending_size += n;
+        data += n;
+        size -= n;
+
+        size_t used = scan(pending, pending_size);
+        std::memmove(pending, pending + used, pending_size - used);
+        pending_size -= used;
+    }
+
+    if (size == 0)
+        return;
+
+    size_t used = scan(data, size);
+
+    // Keep the trailing partial frame, it is always smaller than the buffer
+    std::memcpy(pending, data + used, size - used);
+    pending_size = size - used;
+}
+
+size_t FrameScanner::scan(const uint8_t *data, size_t size)
+{
+    size_t pos = 0;
+    pending_need = 0;
+
+    while (pos < size)
+    {
+        // Skip up to the next possible frame start
+        if (data[pos] != '$' && data[pos] != RTCM3_PREAMBLE)
+        {
+            size_t start = pos;
+            while (pos < size && data[pos] != '$' && data[pos] != RTCM3_PREAMBLE)
+                pos++;
+            skipped_bytes += pos - start;
+            continue;
+        }
+
+        frame_type type = FRAME_NMEA;
+        long length = frame_length(data + pos, size - pos, type);
+        if (length < 0)
+        {
+            // Not a frame, resynchronize on the next byte
+            skipped_bytes++;
+            pos++;
+            continue;
+        }
+        if (length == 0)
+            break; // Incomplete, kept for the next feed
+
+        frames[type]++;
+        Frame frame = {type, data + pos, (size_t)length};
+        on_frame(frame);
+        pos += length;
+    }
+
+    return pos;
+}
+
+long FrameScanner::frame_length(const uint8_t *data, size_t size, frame_type &type)
+{
+    // RTCM3: preamble, 6 reserved bits, 10 bits length, payload, CRC-24Q
+    if (data[0] == RTCM3_PREAMBLE)
+    {
+        type = FRAME_RTCM3;
+        if (size < 3)
+            return 0;
+        if (data[1] & 0xFC)
+            return -1;
+
+        size_t total = (((data[1] & 0x03) << 8) | data[2]) + 6;
+        if (size < total)
+        {
+            pending_need = total;
+            return 0;
+        }
+
+        uint32_t crc = (data[total - 3] << 16) | (data[total - 2] << 8) | data[total - 1];
+        if (crc24q(data, total - 3) != crc)
+        {
+            crc_errors++;
+            return -1;
+        }
+        return total;
+    }
+
+    if (size < 2)
+        return 0;
+
+    // SBF: $@, CRC, ID, Length (header included, multiple of 4), CRC-16 from the ID to the end of the block
+    if (data[1] == '@')
+    {
+        type = FRAME_SBF;
+        if (size < 8)
+            return 0;
+
+        size_t total = data[6] | (data[7] << 8);
+        if (total < 8 || total % 4 != 0)
+            return -1;
+        if (size < total)
+        {
+            pending_need = total;
+            return 0;
+        }
+
+        uint16_t crc = data[2] | (data[3] << 8);
+        if (crc16_ccitt(data + 4, total - 4) != crc)
+        {
+            crc_errors++;
+            return -1;
+        }
+        return total;
+    }
+
+    // ASCII line: NMEA sentence or command reply, up to <LF>
+    if (data[1] < 'A' || data[1] > 'Z')
+        return -1;
+
+    const uint8_t *eol = (const uint8_t *)std::memchr(data, '\n', std::min(size, (size_t)MAX_ASCII_LINE));
+    if (eol == nullptr)
+        return size >= MAX_ASCII_LINE ? -1 : 0;
+
+    size_t total = eol - data + 1;
+
+    if (data[1] == 'R' && total > 2 && (data[2] == ':' || data[2] == '?' || data[2] == ';'))
+    {
+        type = FRAME_REPLY;
+        return total;
+    }
+
+    // Check the NMEA checksum when there is one
+    type = FRAME_NMEA;
+    const uint8_t *star = (const uint8_t *)std::memchr(data, '*', total);
+    if (star != nullptr && star + 2 < eol)
+    {
+        uint8_t checksum = 0;
+        for (const uint8_t *p = data + 1; p < star; p++)
+            checksum ^= *p;
+
+        char expected[3] = {(char)star[1], (char)star[2], 0};
+        if (std::strtoul(expected, nullptr, 16) != checksum)
+        {
+            crc_errors++;
+            return -1;
+        }
+    }
+    return total;
+}
@@ -0,0 +1,144 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "log.hpp"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+bool parse_log_level(const std::string &name, log_level &level)
+{
+    static const char *const names[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = LEVEL_DEBUG; i <= LEVEL_OFF; i++)
+    {
+        if (name == names[i])
+        {
+            level = (log_level)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+void Logger::start(log_level level)
+{
+    min_level = level;
+    if (running.exchange(true))
+        return;
+    writer_thread = std::thread(&Logger::write_lines, this);
+}
+
+void Logger::stop()
+{
+    if (!running.exchange(false))
+        return;
+    cv_writer.notify_one();
+    writer_thread.join();
+}
+
+void Logger::push(log_level level, const char *text, size_t size)
+{
+    if (!running.load(std::memory_order_acquire))
+    {
+        std::ostream &os = level >= LEVEL_ERROR ? std::cerr : std::cout;
+        os.write(text, size);
+        os << std::endl;
+        return;
+    }
+
+    size_t ticket;
+    Record *record = ring.begin_push(ticket);
+    if (record == nullptr)
+        return;
+
+    record->level = level;
+    record->size = std::min(size, sizeof(record->text));
+    std::memcpy(record->text, text, record->size);
+    ring.end_push(ticket);
+
+    // No lock on the producer side: a missed wakeup only delays the line until the writer's timeout
+    cv_writer.notify_one();
+}
+
+void Logger::write_lines()
+{
+    uint64_t reported_drops = 0;
+    for (;;)
+    {
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        size_t written = 0;
+        for (Record *record; (record = ring.front()) != nullptr; ring.pop(), written++)
+        {
+            std::ostream &os = record->level >= LEVEL_ERROR ? std::cerr : std::cout;
+            os.write(record->text, record->size);
+            os.put('\n');
+        }
+
+        if (ring.drops() != reported_drops)
+        {
+            std::cout << "Log: " << ring.drops() - reported_drops << " lines dropped, the console is too slow" << '\n';
+            reported_drops = ring.drops();
+            written++;
+        }
+        if (written > 0)
+        {
+            std::cout.flush();
+            std::cerr.flush();
+        }
+
+        if (stopping)
+            return;
+
+        std::unique_lock<std::mutex> lock(lk_writer);
+        cv_writer.wait_for(lock, std::chrono::milliseconds(50));
+    }
+}
+
+bool LogLimiter::allow(uint64_t &suppressed)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = next_ns.load(std::memory_order_relaxed);
+
+    if (now < next || !next_ns.compare_exchange_strong(next, now + std::chrono::duration_cast<std::chrono::nanoseconds>(LOG_RATE_LIMIT).count()))
+    {
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = skipped.exchange(0, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,103 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "metrics.hpp"
+#include <memory>
+#include <sstream>
+
+// One scrape: the request is read once and ignored, the response is written and the socket closed
+struct MetricsConnection {
+    MetricsConnection(boost::asio::io_service &io_service) : socket(io_service) {}
+
+    boost::asio::ip::tcp::socket socket;
+    char request[METRICS_MAX_REQUEST];
+    std::string response;
+};
+
+bool MetricsServer::start(unsigned short port)
+{
+    boost::system::error_code error;
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+    acceptor.open(endpoint.protocol(), error);
+    if (!error)
+        acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), error);
+    if (!error)
+        acceptor.bind(endpoint, error);
+    if (!error)
+        acceptor.listen(boost::asio::socket_base::max_connections, error);
+    if (error)
+    {
+        std::cout << "Cannot serve the metrics on 127.0.0.1:" << port << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    accept_next();
+    server_thread = std::thread([this]
+                                { io_service.run(); });
+    std::cout << "Metrics served on http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    io_service.stop();
+    if (server_thread.joinable())
+        server_thread.join();
+}
+
+void MetricsServer::accept_next()
+{
+    std::shared_ptr<MetricsConnection> connection = std::make_shared<MetricsConnection>(io_service);
+    acceptor.async_accept(connection->socket, [this, connection](const boost::system::error_code &error)
+                          {
+        if (error)
+            return;
+        accept_next();
+
+        connection->socket.async_read_some(boost::asio::buffer(connection->request), [this, connection](const boost::system::error_code &error, size_t)
+                                           {
+            if (error)
+                return;
+
+            std::ostringstream body;
+            collect(body);
+            scrape_count.fetch_add(1, std::memory_order_relaxed);
+
+            connection->response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                   std::to_string(body.str().size()) + "\r\nConnection: close\r\n\r\n" + body.str();
+            boost::asio::async_write(connection->socket, boost::asio::buffer(connection->response),
+                                     [connection](const boost::system::error_code &, size_t)
+                                     {
+                boost::system::error_code ignored;
+                connection->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            }); }); });
+}
@@ -31,25 +31,173 @@
 // ****************************************************************************
 
 #include "mqtt.hpp"
+#include "log.hpp"
+
+// FNV-1a, also returns the length of the topic
+static uint32_t topic_hash(const char *topic, size_t *length)
+{
+    uint32_t hash = 2166136261u;
+    const char *c = topic;
+    for (; *c != '\0'; c++)
+        hash = (hash ^ (uint8_t) *c) * 16777619u;
+    *length = c - topic;
+    return hash;
+}
+
+void TopicTable::bind(const std::string &topic, topic_id id)
+{
+    std::lock_guard<std::mutex> lock(lk_entries);
+    bind_locked(topic, id);
+}
+
+void TopicTable::bind_locked(const std::string &topic, topic_id id)
+{
+    size_t length;
+    uint32_t hash = topic_hash(topic.c_str(), &length);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entries[i].hash == hash && entries[i].topic == topic)
+        {
+            entries[i].id = id;
+            return;
+        }
+    }
+    if (count == MAX_BOUND_TOPICS)
+    {
+        LOG_ERROR("Too many subscribed topics, " << topic << " is not routed.");
+        return;
+    }
+    entries[count].hash = hash;
+    entries[count].topic = topic;
+    entries[count].id = id;
+    count++;
+}
+
+void TopicTable::unbind(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(lk_entries);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entries[i].topic == topic)
+        {
+            // Keep the entries packed, the order does not matter
+            std::swap(entries[i], entries[count - 1]);
+            count--;
+            return;
+        }
+    }
+}
+
+topic_id TopicTable::resolve(const char *topic)
+{
+    size_t length;
+    uint32_t hash = topic_hash(topic, &length);
+
+    std::lock_guard<std::mutex> lock(lk_entries);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entries[i].hash == hash && entries[i].topic.size() == length && memcmp(entries[i].topic.data(), topic, length) == 0)
+            return entries[i].id;
+    }
+    return TOPIC_NONE;
+}
+
+void TopicTable::set_current(current_slot slot, const std::string &topic, topic_id id)
+{
+    std::lock_guard<std::mutex> lock(lk_entries);
+    current[slot].topic = topic;
+    current[slot].id = id;
+}
+
+void TopicTable::drop_current(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(lk_entries);
+    for (Current &slot : current)
+    {
+        if (slot.topic == topic)
+            slot.topic.clear();
+    }
+}
+
+size_t TopicTable::bind_current(const std::function<bool(const std::string &topic, topic_id id)> &subscribe)
+{
+    std::lock_guard<std::mutex> lock(lk_entries);
+    size_t bound = 0;
+    for (const Current &slot : current)
+    {
+        if (slot.topic.empty() || !subscribe(slot.topic, slot.id))
+            continue;
+        bind_locked(slot.topic, slot.id);
+        bound++;
+    }
+    return bound;
+}
+
+static int topic_qos(const UserData *user_data, topic_id id)
+{
+    return id == TOPIC_TILE ? user_data->tileQoS : user_data->nodeQoS;
+}
+
+bool mqtt_replace_topic(UserData *user_data, struct mosquitto *client, struct mosquitto *draining,
+                        current_slot slot, const std::string &previous, const std::string &topic, topic_id id)
+{
+    user_data->topics.set_current(slot, topic, id);
+
+    if (!previous.empty() && previous != topic)
+    {
+        for (struct mosquitto *subscriber : {client, draining})
+        {
+            if (subscriber == nullptr)
+                continue;
+            // A client not connected yet has not subscribed it
+            int result = mosquitto_unsubscribe(subscriber, NULL, previous.c_str());
+            if (result == MOSQ_ERR_SUCCESS)
+                LOG_INFO("Unsubscribed from topic: " << previous);
+            else if (result != MOSQ_ERR_NO_CONN)
+                LOG_ERROR("Error unsubscribing from " << previous << " topic: " << mosquitto_strerror(result));
+        }
+        user_data->topics.unbind(previous);
+    }
+    if (topic.empty())
+        return true;
+
+    int result = mosquitto_subscribe(client, NULL, topic.c_str(), topic_qos(user_data, id));
+    if (result == MOSQ_ERR_NO_CONN)
+    {
+        LOG_INFO("Subscribing to topic " << topic << " once connected");
+        return true;
+    }
+    if (result != MOSQ_ERR_SUCCESS)
+    {
+        LOG_ERROR("Error subscribing to " << topic << " topic: " << mosquitto_strerror(result));
+        return false;
+    }
+    LOG_INFO("Subscribed to topic: " << topic);
+    user_data->topics.bind(topic, id);
+    return true;
+}
 
 
 void mqtt_on_connect(struct mosquitto *mqttClient, void *userdata, int result) {
     if (result == 0) {
-        std::cout << "Connected to broker.\n\nSubscribing to topics ... \n" << std::endl;
+        LOG_INFO("Connected to broker.\n\nSubscribing to topics ... \n");
 
         // Access the userdata object
         UserData *user_data = (UserData *)userdata;
+        user_data->connects++;
 
         // Only subscribe if not localized or in Lband mode
         if (!user_data->localized || (user_data->corrections_mode == "Lb" ||user_data->corrections_mode == "Dual")){
             // Dynamic Key Topic and QoS = 
             result = mosquitto_subscribe(mqttClient, NULL, user_data->keyTopic.c_str(), user_data->keyQoS);
             if (result != MOSQ_ERR_SUCCESS) {
-                std::cerr << "\nError subscribing to " << user_data->keyTopic.c_str() << " topic.\n" << std::endl;
+                LOG_ERROR("\nError subscribing to " << user_data->keyTopic.c_str() << " topic.\n");
 
             } else { 
-                std::cout << "Subscribed to topic: " << user_data->keyTopic.c_str() << std::endl;
-                std::cout << "QoS of the topic: 1\n" << std::endl;
+                LOG_INFO("Subscribed to topic: " << user_data->keyTopic.c_str());
+                user_data->topics.bind(user_data->keyTopic, TOPIC_KEY);
+                LOG_INFO("QoS of the topic: 1\n");
             }
         }
         
@@ -58,11 +206,12 @@ void mqtt_on_connect(struct mosquitto *mqttClient, void *userdata, int result) {
                 // Frequency Topic and QoS = 1
                 result = mosquitto_subscribe(mqttClient, NULL, user_data->freqTopic.c_str(), user_data->freqQoS);
                 if (result != MOSQ_ERR_SUCCESS) {
-                    std::cerr << "\nError subscribing to " << user_data->freqTopic.c_str() << " topic.\n" << std::endl;
+                    LOG_ERROR("\nError subscribing to " << user_data->freqTopic.c_str() << " topic.\n");
 
                 } else { 
-                    std::cout << "Subscribed to topic: " << user_data->freqTopic.c_str() << std::endl;
-                    std::cout << "QoS of the topic: 1\n" << std::endl;
+                    LOG_INFO("Subscribed to topic: " << user_data->freqTopic.c_str());
+                    user_data->topics.bind(user_data->freqTopic, TOPIC_FREQ);
+                    LOG_INFO("QoS of the topic: 1\n");
                 }
             }
             
@@ -71,47 +220,82 @@ void mqtt_on_connect(struct mosquitto *mqttClient, void *userdata, int result) {
                 // Corrections Topic and QoS = 0
                 result = mosquitto_subscribe(mqttClient, NULL, user_data->corrTopic.c_str(), user_data->corrQoS);
                 if (result != MOSQ_ERR_SUCCESS) {
-                    std::cerr << "\nError subscribing to " << user_data->corrTopic.c_str() << " topic.\n" << std::endl;
+                    LOG_ERROR("\nError subscribing to " << user_data->corrTopic.c_str() << " topic.\n");
 
                 } else { 
-                    std::cout << "Subscribed to topic: " << user_data->corrTopic.c_str() << std::endl;
-                    std::cout << "QoS of the topic: 0\n" << std::endl;
+                    LOG_INFO("Subscribed to topic: " << user_data->corrTopic.c_str());
+                    user_data->topics.bind(user_data->corrTopic, TOPIC_CORR);
+                    LOG_INFO("QoS of the topic: 0\n");
                 }
             }
-            if(user_data->nodeTopic != "" && user_data->localized && (user_data->corrections_mode == "Ip" || user_data->corrections_mode == "Dual") ){
-                result = mosquitto_subscribe(mqttClient, NULL, user_data->nodeTopic.c_str(), user_data->nodeQoS);
-                if (result != MOSQ_ERR_SUCCESS) {
-                    std::cerr << "\nError subscribing to " << user_data->nodeTopic.c_str() << " topic.\n" << std::endl;
-
-                } else { 
-                    std::cout << "Subscribed to topic: " << user_data->nodeTopic.c_str() << std::endl;
-                    std::cout << "QoS of the topic: 0\n" << std::endl;
-                }
+            // Node, tile and the topics subscribed ahead are rewritten by the dispatch thread, they are read under the topic table lock
+            if(user_data->localized && (user_data->corrections_mode == "Ip" || user_data->corrections_mode == "Dual") ){
+                user_data->topics.bind_current([&](const std::string &topic, topic_id id) {
+                    result = mosquitto_subscribe(mqttClient, NULL, topic.c_str(), topic_qos(user_data, id));
+                    if (result != MOSQ_ERR_SUCCESS) {
+                        LOG_ERROR("\nError subscribing to " << topic.c_str() << " topic.\n");
+                        return false;
+                    }
+                    LOG_INFO("Subscribed to topic: " << topic.c_str());
+                    LOG_INFO("QoS of the topic: " << topic_qos(user_data, id) << "\n");
+                    return true;
+                });
             }
         
 
     } else {
-        std::cout << "Connection failed with error code: " << result << "\n" << std::endl;
+        LOG_ERROR("Connection failed with error code: " << result << "\n");
     }
 }
 
 void mqtt_on_message(struct mosquitto *mqttClient, void *userdata, const struct mosquitto_message *message) {
     // Access the userdata object
     UserData *user_data = (UserData *)userdata;
+    latency_clock::time_point arrival = latency_clock::now();
+
+    topic_id id = user_data->topics.resolve(message->topic);
+    if (id == TOPIC_NONE)
+    {
+        // Late message of a topic that has been unsubscribed
+        user_data->unknown_topics++;
+        return;
+    }
+    user_data->topic_messages[id].fetch_add(1, std::memory_order_relaxed);
+    user_data->topic_bytes[id].fetch_add(message->payloadlen, std::memory_order_relaxed);
 
+    // A node subscribed ahead is only counted: in the drop-oldest ring its SPARTN would evict the current node's
+    if (id == TOPIC_NODE_WARM)
+        return;
+
+    // Fill a pre-allocated slot of the ring, the buffers keep their capacity from one message to the next
+    std::unique_lock<std::mutex> producer(user_data->lk_producer);
+    struct mqttMessgae *toPush = user_data->message_queue.begin_push();
+    if (toPush != nullptr)
+    {
+        size_t capacity = toPush->topic.capacity() + toPush->payload.capacity();
+
+        toPush->id = id;
+        toPush->topic.assign(message->topic);
+        toPush->payload.assign((char *) message->payload, message->payloadlen);
+        toPush->payloadlen = message->payloadlen;
+        toPush->stamp = arrival;
+        toPush->client = mqttClient;
+
+        if (toPush->topic.capacity() + toPush->payload.capacity() != capacity)
+            user_data->message_allocations++;
+
+        user_data->message_queue.end_push();
+        user_data->message_counters.on_push(user_data->message_queue.size());
+    }
+    producer.unlock();
 
-    struct mqttMessgae toPush;
-    toPush.topic = std::string(message->topic);
-    toPush.payload = std::string((char *) message->payload, message->payloadlen);
-    toPush.payloadlen = message->payloadlen;
-    
-    user_data->message_queue_mutex.lock();
-    user_data->message_queue.push(toPush);
-    user_data->message_queue_mutex.unlock();    
+    user_data->lk_incoming_data->lock();
+    user_data->lk_incoming_data->unlock();
     user_data->cv_incoming_data->notify_all();
 
-    if(message->topic == user_data->tileTopic){
-        mosquitto_unsubscribe(mqttClient , NULL, user_data->tileTopic.c_str()) ;
+    // The tile dictionary is only needed once, it stays bound for a message already in flight
+    if(id == TOPIC_TILE){
+        mosquitto_unsubscribe(mqttClient , NULL, message->topic) ;
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "node_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Relative error allowed to the equirectangular distance, far above its error within a tile
+#define NODE_INDEX_PREFILTER 0.01f
+
+static const float PI_F = 3.14159265358979f;
+static const float DEG_TO_RAD = PI_F / 180;
+
+// Digits of s[pos, pos + len) as 1/100 degrees, false if one is not a digit
+static bool parse_hundredths(const std::string &s, size_t pos, size_t len, float &degrees)
+{
+    int value = 0;
+    for (size_t i = pos; i < pos + len; i++)
+    {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        value = value * 10 + (s[i] - '0');
+    }
+    degrees = value / 100.0f;
+    return true;
+}
+
+// Longitude difference wrapped to [-pi, pi]
+static float wrap(float dlon)
+{
+    if (dlon > PI_F)
+        return dlon - 2 * PI_F;
+    if (dlon < -PI_F)
+        return dlon + 2 * PI_F;
+    return dlon;
+}
+
+size_t NodeIndex::build(const std::vector<std::string> &nodes)
+{
+    names.clear();
+    lat.clear();
+    lon.clear();
+    cos_lat.clear();
+
+    size_t invalid = 0;
+    for (const std::string &node : nodes)
+    {
+        float node_lat, node_lon;
+        if (node.size() < 11 || (node[0] != 'N' && node[0] != 'S') || (node[5] != 'E' && node[5] != 'W') ||
+            !parse_hundredths(node, 1, 4, node_lat) || !parse_hundredths(node, 6, 5, node_lon))
+        {
+            invalid++;
+            continue;
+        }
+        if (node[0] == 'S')
+            node_lat = -node_lat;
+        if (node[5] == 'W')
+            node_lon = -node_lon;
+
+        names.push_back(node);
+        lat.push_back(node_lat * DEG_TO_RAD);
+        lon.push_back(node_lon * DEG_TO_RAD);
+        cos_lat.push_back(std::cos(node_lat * DEG_TO_RAD));
+    }
+
+    rows = cols = 0;
+    cell_start.clear();
+    cell_nodes.clear();
+    if (names.empty())
+        return invalid;
+
+    // Square grid of about one node per cell over the bounding box
+    float max_lat, max_lon;
+    min_lat = max_lat = lat[0];
+    min_lon = max_lon = lon[0];
+    for (size_t i = 1; i < lat.size(); i++)
+    {
+        min_lat = std::min(min_lat, lat[i]);
+        max_lat = std::max(max_lat, lat[i]);
+        min_lon = std::min(min_lon, lon[i]);
+        max_lon = std::max(max_lon, lon[i]);
+    }
+    rows = cols = std::max(1, (int)std::ceil(std::sqrt((float)names.size())));
+
+    // Across the antimeridian the longitudes do not bound the distance, rows only
+    if (max_lon - min_lon > PI_F)
+        cols = 1;
+    cell_lat = std::max((max_lat - min_lat) / rows, 1e-6f);
+    cell_lon = std::max((max_lon - min_lon) / cols, 1e-6f);
+    min_cos_lat = std::min(std::cos(min_lat), std::cos(max_lat));
+
+    std::vector<uint32_t> cell_of(names.size());
+    cell_start.assign(rows * cols + 1, 0);
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        int row = std::min(rows - 1, (int)((lat[i] - min_lat) / cell_lat));
+        int col = std::min(cols - 1, (int)((lon[i] - min_lon) / cell_lon));
+        cell_of[i] = row * cols + col;
+        cell_start[cell_of[i] + 1]++;
+    }
+    for (int c = 0; c < rows * cols; c++)
+        cell_start[c + 1] += cell_start[c];
+
+    std::vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+    cell_nodes.resize(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        cell_nodes[fill[cell_of[i]]++] = i;
+
+    return invalid;
+}
+
+// Equirectangular distance (radians) from the position to the nodes outside the cells within ring of (row, col)
+float NodeIndex::lower_bound(int row, int col, int ring, float query_lat, float query_lon, float query_cos) const
+{
+    float lon_scale = std::min(min_cos_lat, query_cos);
+    float bound = std::numeric_limits<float>::max();
+    if (row - ring > 0)
+        bound = std::min(bound, query_lat - (min_lat + (row - ring) * cell_lat));
+    if (row + ring < rows - 1)
+        bound = std::min(bound, min_lat + (row + ring + 1) * cell_lat - query_lat);
+    if (col - ring > 0)
+        bound = std::min(bound, (query_lon - (min_lon + (col - ring) * cell_lon)) * lon_scale);
+    if (col + ring < cols - 1)
+        bound = std::min(bound, (min_lon + (col + ring + 1) * cell_lon - query_lon) * lon_scale);
+    return std::max(bound, 0.0f);
+}
+
+int NodeIndex::nearest(float latitude, float longitude) const
+{
+    if (names.empty())
+        return -1;
+
+    float query_lat = latitude * DEG_TO_RAD;
+    float query_lon = longitude * DEG_TO_RAD;
+    float query_cos = std::cos(query_lat);
+
+    int row = std::max(0, std::min(rows - 1, (int)std::floor((query_lat - min_lat) / cell_lat)));
+    int col = std::max(0, std::min(cols - 1, (int)std::floor((query_lon - min_lon) / cell_lon)));
+
+    int best = -1;
+    float best_flat = std::numeric_limits<float>::max();
+    float best_haversine = std::numeric_limits<float>::max();
+    for (int ring = 0; ring < std::max(rows, cols); ring++)
+    {
+        for (int r = std::max(0, row - ring); r <= std::min(rows - 1, row + ring); r++)
+        {
+            // Only the border of the ring, the inside has been visited
+            bool border_row = r == row - ring || r == row + ring;
+            int step = border_row ? 1 : 2 * ring;
+            for (int c = col - ring; c <= col + ring; c += std::max(step, 1))
+            {
+                if (c < 0 || c >= cols)
+                    continue;
+                for (uint32_t k = cell_start[r * cols + c]; k < cell_start[r * cols + c + 1]; k++)
+                {
+                    uint32_t i = cell_nodes[k];
+                    float dlat = lat[i] - query_lat;
+                    float dlon = wrap(lon[i] - query_lon);
+                    float x = dlon * 0.5f * (query_cos + cos_lat[i]);
+                    float flat = std::sqrt(dlat * dlat + x * x);
+                    if (flat > best_flat * (1 + NODE_INDEX_PREFILTER))
+                        continue;
+
+                    // Haversine without its asin and sqrt, both increasing
+                    float sin_dlat = std::sin(dlat / 2);
+                    float sin_dlon = std::sin(dlon / 2);
+                    float haversine = sin_dlat * sin_dlat + query_cos * cos_lat[i] * sin_dlon * sin_dlon;
+                    if (haversine < best_haversine)
+                    {
+                        best_haversine = haversine;
+                        best = i;
+                    }
+                    best_flat = std::min(best_flat, flat);
+                }
+            }
+        }
+        if (best >= 0 && lower_bound(row, col, ring, query_lat, query_lon, query_cos) > best_flat * (1 + NODE_INDEX_PREFILTER))
+            break;
+    }
+    return best;
+}
+
+int NodeIndex::find(const std::string &node) const
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i] == node)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,176 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "ppl_backend.hpp"
+#include "utils.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#define MOCK_RTCM3_MESSAGE 4062
+#define MOCK_RTCM3_MAX_PAYLOAD 1023
+#define MOCK_MAX_PENDING 64
+
+#ifdef SSNPPL_WITH_PPL
+// ppl_real.cpp, the only file including PPL_PublicInterface.h
+PplBackend *create_real_ppl();
+#endif
+
+const char *default_ppl_backend()
+{
+#ifdef SSNPPL_WITH_PPL
+    return "real";
+#else
+    return "mock";
+#endif
+}
+
+PplBackend *create_ppl_backend(const std::string &name, const MockPplConfig &mock_config)
+{
+    if (name == "mock")
+        return new MockPpl(mock_config);
+#ifdef SSNPPL_WITH_PPL
+    if (name == "real")
+        return create_real_ppl();
+#endif
+    return nullptr;
+}
+
+void MockPpl::spend() const
+{
+    if (config.cost_us == 0)
+        return;
+
+    // Busy wait, the cost of the library is CPU time on the PPL thread
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(config.cost_us);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+ppl_status MockPpl::initialize(unsigned int channels)
+{
+    this->channels = channels;
+    initialized = true;
+    return PPL_STATUS_SUCCESS;
+}
+
+ppl_status MockPpl::send_dynamic_key(const char *key, size_t size)
+{
+    calls[CALL_KEY]++;
+    spend();
+    return key == nullptr || size == 0 ? PPL_STATUS_INCORRECT_USAGE : PPL_STATUS_SUCCESS;
+}
+
+ppl_status MockPpl::accept_spartn(const void *data, size_t size, unsigned int channel)
+{
+    spend();
+    if (!initialized || (channels & channel) == 0)
+        return PPL_STATUS_INIT_FAILED;
+    if (data == nullptr)
+        return PPL_STATUS_INCORRECT_USAGE;
+
+    size_t payload = config.rtcm_bytes > 0 ? config.rtcm_bytes : size;
+    if (payload > MOCK_RTCM3_MAX_PAYLOAD)
+        payload = MOCK_RTCM3_MAX_PAYLOAD;
+    if (payload < 2)
+        payload = 2;
+
+    // Like the library, output not collected in time is lost
+    if (pending.size() == MOCK_MAX_PENDING)
+        pending.pop_front();
+    pending.push_back(payload);
+    return PPL_STATUS_SUCCESS;
+}
+
+ppl_status MockPpl::send_spartn(const void *data, size_t size)
+{
+    calls[CALL_SPARTN]++;
+    return accept_spartn(data, size, PPL_CHANNEL_IP);
+}
+
+ppl_status MockPpl::send_aux_spartn(const void *data, size_t size)
+{
+    calls[CALL_AUX_SPARTN]++;
+    return accept_spartn(data, size, PPL_CHANNEL_AUX);
+}
+
+ppl_status MockPpl::send_rcvr_data(const void *data, size_t /*size*/)
+{
+    calls[CALL_RCVR]++;
+    spend();
+    if (!initialized)
+        return PPL_STATUS_INIT_FAILED;
+    return data == nullptr ? PPL_STATUS_INCORRECT_USAGE : PPL_STATUS_SUCCESS;
+}
+
+ppl_status MockPpl::get_rtcm_output(uint8_t *buffer, size_t size, uint32_t *rtcm_size)
+{
+    calls[CALL_RTCM]++;
+    if (buffer == nullptr || rtcm_size == nullptr)
+        return PPL_STATUS_INCORRECT_USAGE;
+
+    // Preamble, 10 bits length, 12 bits message number, zero filled body, CRC-24Q
+    size_t used = 0;
+    while (!pending.empty() && used + 3 + pending.front() + 3 <= size)
+    {
+        uint16_t payload = pending.front();
+        pending.pop_front();
+
+        uint8_t *frame = buffer + used;
+        memset(frame, 0, 3 + payload + 3);
+        frame[0] = 0xD3;
+        frame[1] = (payload >> 8) & 0x03;
+        frame[2] = payload & 0xFF;
+        frame[3] = MOCK_RTCM3_MESSAGE >> 4;
+        frame[4] = (MOCK_RTCM3_MESSAGE & 0x0F) << 4;
+
+        uint32_t crc = crc24q(frame, 3 + payload);
+        frame[3 + payload] = crc >> 16;
+        frame[4 + payload] = crc >> 8;
+        frame[5 + payload] = crc;
+
+        used += 3 + payload + 3;
+        rtcm_frames++;
+    }
+    rtcm_bytes += used;
+
+    *rtcm_size = used;
+    return PPL_STATUS_SUCCESS;
+}
+
+void MockPpl::print(std::ostream &os) const
+{
+    os << "  *Mock PPL               cost=" << config.cost_us << "us"
+       << " key=" << calls[CALL_KEY] << " spartn=" << calls[CALL_SPARTN]
+       << " aux_spartn=" << calls[CALL_AUX_SPARTN] << " rcvr=" << calls[CALL_RCVR]
+       << " rtcm_frames=" << rtcm_frames << " rtcm_bytes=" << rtcm_bytes << std::endl;
+}
@@ -0,0 +1,90 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "ppl_backend.hpp"
+#include "PPL_PublicInterface.h" // PointPerfect Library
+#include <limits>
+
+static_assert(PPL_RTCM_BUFFER_SIZE == PPL_MAX_RTCM_BUFFER, "PPL_RTCM_BUFFER_SIZE differs from the library");
+static_assert(PPL_STATUS_SUCCESS == ePPL_Success, "PPL_STATUS_SUCCESS differs from the library");
+
+// The library takes 16 bits buffer sizes
+static bool fits(size_t size)
+{
+    return size <= std::numeric_limits<uint16_t>::max();
+}
+
+class RealPpl : public PplBackend {
+    public:
+        const char *name() const override { return "real"; }
+
+        ppl_status initialize(unsigned int channels) override
+        {
+            uint32_t mask = PPL_CFG_DEFAULT_CFG;
+            if (channels & PPL_CHANNEL_IP)
+                mask |= PPL_CFG_ENABLE_IP_CHANNEL;
+            if (channels & PPL_CHANNEL_AUX)
+                mask |= PPL_CFG_ENABLE_AUX_CHANNEL;
+            return PPL_Initialize(mask);
+        }
+
+        ppl_status send_dynamic_key(const char *key, size_t size) override
+        {
+            if (size > std::numeric_limits<uint8_t>::max())
+                return ePPL_IncorrectLibUsage;
+            return PPL_SendDynamicKey(key, size);
+        }
+
+        ppl_status send_spartn(const void *data, size_t size) override
+        {
+            return fits(size) ? PPL_SendSpartn(data, size) : ePPL_IncorrectLibUsage;
+        }
+
+        ppl_status send_aux_spartn(const void *data, size_t size) override
+        {
+            return fits(size) ? PPL_SendAuxSpartn(data, size) : ePPL_IncorrectLibUsage;
+        }
+
+        ppl_status send_rcvr_data(const void *data, size_t size) override
+        {
+            return fits(size) ? PPL_SendRcvrData(data, size) : ePPL_IncorrectLibUsage;
+        }
+
+        ppl_status get_rtcm_output(uint8_t *buffer, size_t size, uint32_t *rtcm_size) override
+        {
+            return PPL_GetRTCMOutput(buffer, size, rtcm_size);
+        }
+};
+
+PplBackend *create_real_ppl()
+{
+    return new RealPpl();
+}
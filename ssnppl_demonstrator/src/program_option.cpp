@@ -42,26 +42,43 @@ ProgramOptions ParseProgramOptions(int argc, char* argv[]) {
         // General program Logic
         ("mode", po::value<std::string>(&options.mode)->required(),                                             "mode                       Required | Ip, Lb or Dual.")
         ("echo", po::value<bool>(&options.echo)->default_value(false),                                          "echo                       Optional | true or false.")
+        ("log_level", po::value<std::string>(&options.log_level)->default_value("info"),                        "log_level                  Optional | debug, info, warn, error or off. Debug needs a build with SSNPPL_DEBUG_LOGS. By Default: info")
         ("reset_default", po::value<bool>(&options.reset_default)->default_value(false),                        "reset_default                      Optional | Set Default config.")
         ("send_cmds", po::value<bool>(&options.send_cmds)->default_value(true),                                 "send_cmds                  Optional | Sends config cmds before main processing loop if TRUE.")
         ("timer", po::value<int>(&options.timer)->default_value(0),                                             "timer                      Optional | Timer to specify how long the program will run, in secs.")
+        ("stats_interval", po::value<int>(&options.stats_interval)->default_value(0),                           "stats_interval             Optional | Print the correction latency every this many secs, 0 to disable. By Default: 0")
+        ("metrics_port", po::value<int>(&options.metrics_port)->default_value(0),                               "metrics_port               Optional | Serve Prometheus metrics on http://127.0.0.1:[port]/metrics, 0 to disable. By Default: 0")
+        ("ingest", po::value<std::string>(&options.ingest)->default_value("event"),                             "ingest                     Optional | event or poll. How receiver data is read, By Default: event")
+        ("queue_overflow", po::value<std::string>(&options.queue_overflow)->default_value("drop"),              "queue_overflow             Optional | drop (oldest) or block. When an internal queue is full, By Default: drop")
+        ("replay", po::value<std::string>(&options.replay)->default_value("none"),                              "replay                     Optional | Log name to replay instead of the receiver and MQTT: reads [name]_Ip.bin, [name]_Lb.bin, [name]_Rcvr.bin")
+        ("replay_speed", po::value<double>(&options.replay_speed)->default_value(1.0),                          "replay_speed               Optional | 1 for the recorded pace, 2 twice faster ..., 0 as fast as possible. By Default: 1")
+        ("rtcm_output", po::value<std::string>(&options.rtcm_output)->default_value("none"),                    "rtcm_output                Optional | Write RTCM to this file or to a new pseudo terminal (pty) instead of the receiver")
+        ("ppl_backend", po::value<std::string>(&options.ppl_backend)->default_value(default_ppl_backend()),     "ppl_backend                Optional | real (PointPerfect library) or mock (synthetic RTCM, for tests)")
+        ("ppl_mock_cost_us", po::value<unsigned int>(&options.ppl_mock_cost_us)->default_value(0),             "ppl_mock_cost_us           Optional | CPU time of each mock PPL call, in us. By Default: 0")
+        ("ppl_mock_rtcm_bytes", po::value<unsigned int>(&options.ppl_mock_rtcm_bytes)->default_value(0),       "ppl_mock_rtcm_bytes        Optional | RTCM3 payload bytes per SPARTN message of the mock PPL, 0 for the SPARTN size. By Default: 0")
 
         // Logging Configuration
         ("SPARTN_Logging", po::value<std::string>(&options.SPARTN_Logging)->default_value("none"),              "SPARTN_Logging:            Optional | Introduce Spartn Logfile name.")
+        ("SPARTN_Log_sync", po::value<std::string>(&options.SPARTN_Log_sync)->default_value("none"),            "SPARTN_Log_sync:           Optional | none, fdatasync or direct (O_DIRECT). By Default: none")
+        ("SPARTN_Log_flush_kb", po::value<int>(&options.SPARTN_Log_flush_kb)->default_value(16),                "SPARTN_Log_flush_kb:       Optional | Write the SPARTN log once this many KB are buffered. By Default: 16")
+        ("SPARTN_Log_flush_ms", po::value<int>(&options.SPARTN_Log_flush_ms)->default_value(500),               "SPARTN_Log_flush_ms:       Optional | Write the SPARTN log at least this often, in ms. By Default: 500")
+        ("SPARTN_Log_rotate", po::value<std::string>(&options.SPARTN_Log_rotate)->default_value("none"),        "SPARTN_Log_rotate:         Optional | none, hour (GPS hour) or a size in MB. By Default: none")
+        ("rcvr_capture", po::value<std::string>(&options.rcvr_capture)->default_value("none"),                  "rcvr_capture:              Optional | Record the main channel to [name]_Rcvr.bin, to replay it later")
+        ("startup_trace", po::value<std::string>(&options.startup_trace)->default_value("none"),                "startup_trace:             Optional | Write the startup phases and time to first RTCM to this JSON file on exit")
         ("logging", po::value<std::string>(&options.logging)->default_value("none"),                            "logging:                   Optional | Introduce SBF and/or NMEA Logfile name.")
         ("SBF_Logging_Config", po::value<std::string>(&options.SBF_Logging_Config)->default_value("none"),      "SBF_Logging_Config:        Optional | If enable_SBF_logging: [Messages@Interval].") //E.g: --SBF_logging_config Support@sec1
         ("NMEA_Logging_Config", po::value<std::string>(&options.NMEA_Logging_Config)->default_value("none"),    "NMEA_Logging_Config:       Optional | If enable_SBF_logging: [Messages@Interval].") //E.g: --NMEA_Logging_Config GGA+ZDA@sec1
 
         // Main Channel Config
-        ("main_comm", po::value<std::string>(&options.main_comm)->required(),                                   "main_comm:                 Required | USB or Ip")
-        ("main_config", po::value<std::string>(&options.main_config)->required(),                               "main_config:               Required | If USB: port@baudrate If IP: address@port")
+        ("main_comm", po::value<std::string>(&options.main_comm)->default_value("none"),                       "main_comm:                 Required | USB or IP (not with replay)")
+        ("main_config", po::value<std::string>(&options.main_config)->default_value("none"),                     "main_config:               Required | If USB: port@baudrate If IP: address@port (not with replay)")
         
         // Lband Channel Config
-        ("lband_comm", po::value<std::string>(&options.lband_comm)->default_value("none"),                      "lband_comm:                Optional | USB or Ip")
+        ("lband_comm", po::value<std::string>(&options.lband_comm)->default_value("none"),                      "lband_comm:                Optional | USB or IP")
         ("lband_config", po::value<std::string>(&options.lband_config)->default_value("none"),                  "lband_config:              Optional | If USB: port@baudrate If IP: address@port")
 
         // MQTT Config
-        ("client_id", po::value<std::string>(&options.client_id)->required(),                                   "client_id:                 Required | Your client id")
+        ("client_id", po::value<std::string>(&options.client_id)->default_value("none"),                       "client_id:                 Required | Your client id (not with replay)")
         ("mqtt_server", po::value<std::string>(&options.mqtt_server)->default_value("pp.services.u-blox.com"),  "mqtt_server                Optional | By Default: pp.services.u-blox.com")
         ("region", po::value<std::string>(&options.region)->default_value("eu"),                                "region                     Optional | By Default: eu")
         ("mqtt_auth_folder", po::value<std::string>(&options.mqtt_auth_folder)->default_value("auth"),           "mqtt_auth_folder:         Optional | Path to auth folder, By default : current folder")
@@ -69,7 +86,12 @@ ProgramOptions ParseProgramOptions(int argc, char* argv[]) {
         // Localized Distribution Config 
         ("localized", po::value<bool>(&options.localized)->default_value(false),                                "localized                  Optional | Use Localized services , By Default: false")
         ("tile_level",po::value<int>(&options.tile_level)->default_value(2),                                    "tile_level:                Optional | Tile level for localized service (0,1,2) , By default : 2 ")
-        ("distance",po::value<int>(&options.distance)->default_value(10000),                                    "distance:                  Optional | The distance threshold [m] for recalculating tile and node , By default : 10000 ");
+        ("distance",po::value<int>(&options.distance)->default_value(10000),                                    "distance:                  Optional | The distance threshold [m] for recalculating tile and node , By default : 10000 ")
+        ("hysteresis",po::value<int>(&options.hysteresis)->default_value(1000),                                 "hysteresis:                Optional | Margin [m] by which the position must leave the tile, or another node be closer, before switching, By default : 1000")
+        ("recompute_interval",po::value<double>(&options.recompute_interval)->default_value(5.0),               "recompute_interval:        Optional | Minimum time [s] between two recalculations of tile and node, By default : 5")
+        ("tile_cache",po::value<std::string>(&options.tile_cache)->default_value("none"),                       "tile_cache:                Optional | File keeping the tile dictionaries across restarts, By default : none")
+        ("tile_cache_size",po::value<int>(&options.tile_cache_size)->default_value(32),                         "tile_cache_size:           Optional | Tile dictionaries kept, the least recently used is dropped, By default : 32")
+        ("tile_cache_ttl",po::value<int>(&options.tile_cache_ttl)->default_value(86400),                        "tile_cache_ttl:            Optional | Age [s] after which a tile dictionary is downloaded again, 0 for never, By default : 86400");
         
     po::variables_map vm;
 
@@ -92,6 +114,7 @@ void showOptions(const ProgramOptions &options) {
     std::cout << "  *echo:                  ";
     if(options.echo == true) std::cout << "True" << std::endl;
     else std::cout << "False" << std::endl;
+    std::cout << "  *log_level:             " << options.log_level << std::endl;
 
     std::cout << "  *reset_default:         ";
     if(options.reset_default== true) std::cout << "True" << std::endl;
@@ -104,14 +127,42 @@ void showOptions(const ProgramOptions &options) {
     std::cout << "  *timer:                 ";
     if(options.timer > 0) std::cout << options.timer << " Seconds" << std::endl;
     else std::cout << "Disabled" << std::endl;
+    std::cout << "  *stats_interval:        ";
+    if(options.stats_interval > 0) std::cout << options.stats_interval << " Seconds" << std::endl;
+    else std::cout << "Disabled" << std::endl;
+    std::cout << "  *metrics_port:          ";
+    if(options.metrics_port > 0) std::cout << options.metrics_port << std::endl;
+    else std::cout << "Disabled" << std::endl;
+    std::cout << "  *ingest:                " << options.ingest << std::endl;
+    std::cout << "  *queue_overflow:        " << options.queue_overflow << std::endl;
+    if (options.replay != "none") {
+    std::cout << "  *replay:                " << options.replay << std::endl;
+    std::cout << "  *replay_speed:          ";
+    if (options.replay_speed > 0) std::cout << options.replay_speed << "x" << std::endl;
+    else std::cout << "As fast as possible" << std::endl;
+    }
+    std::cout << "  *ppl_backend:           " << options.ppl_backend << std::endl;
+    if (options.ppl_backend == "mock")
+    std::cout << "  *ppl_mock:              " << options.ppl_mock_cost_us << " us/call, " << options.ppl_mock_rtcm_bytes << " RTCM bytes" << std::endl;
+    if (options.rtcm_output != "none")
+    std::cout << "  *rtcm_output:           " << options.rtcm_output << std::endl;
     std::cout << "  *Localized services     ";
     if(options.localized == true) {std::cout << "Enabled" << std::endl;
     std::cout << "  *Tile Level             " << options.tile_level << std::endl;
     std::cout << "  *Distance               " << options.distance << std::endl ;
+    std::cout << "  *Hysteresis             " << options.hysteresis << " m, every " << options.recompute_interval << " s at most" << std::endl;
+    std::cout << "  *Tile cache             " << options.tile_cache << ", " << options.tile_cache_size << " tiles, TTL " << options.tile_cache_ttl << " s" << std::endl;
     }else
     std::cout << "Disabled" << std::endl;
     std::cout << "\nLOGING OPTIONS:\n" << std::endl;
     std::cout << "  *SPARTN_Logging:        " << options.SPARTN_Logging << std::endl;
+    if (options.SPARTN_Logging != "none") {
+    std::cout << "  *SPARTN_Log_sync:       " << options.SPARTN_Log_sync << std::endl;
+    std::cout << "  *SPARTN_Log_flush:      " << options.SPARTN_Log_flush_kb << " KB / " << options.SPARTN_Log_flush_ms << " ms" << std::endl;
+    std::cout << "  *SPARTN_Log_rotate:     " << options.SPARTN_Log_rotate << std::endl;
+    }
+    std::cout << "  *rcvr_capture:          " << options.rcvr_capture << std::endl;
+    std::cout << "  *startup_trace:         " << options.startup_trace << std::endl;
     std::cout << "  *logging:               " << options.logging << std::endl;
     std::cout << "  *SBF_Logging_Config:    " << options.SBF_Logging_Config << std::endl;
     std::cout << "  *NMEA_Logging_Config:   " << options.NMEA_Logging_Config << std::endl;
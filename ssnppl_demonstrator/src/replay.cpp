@@ -0,0 +1,96 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "replay.hpp"
+
+#include <cstring>
+#include <iostream>
+
+static uint64_t get_le(const char *in, int size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | (uint8_t)in[i];
+    return value;
+}
+
+bool ReplayReader::open(const std::string &file_name)
+{
+    name = file_name;
+    file.open(file_name, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    char sync[4] = {};
+    file.read(sync, sizeof(sync));
+    raw_file = file.gcount() < (std::streamsize)sizeof(sync) || memcmp(sync, SPARTN_LOG_SYNC, sizeof(sync)) != 0;
+    file.clear();
+    file.seekg(0);
+
+    record.reserve(REPLAY_RAW_CHUNK);
+    return next();
+}
+
+bool ReplayReader::next()
+{
+    has_record = false;
+
+    if (raw_file)
+    {
+        record.resize(REPLAY_RAW_CHUNK);
+        file.read((char *)record.data(), REPLAY_RAW_CHUNK);
+        record.resize(file.gcount());
+    }
+    else
+    {
+        char header[SPARTN_LOG_HEADER_SIZE];
+        if (!file.read(header, sizeof(header)))
+            return false;
+        if (memcmp(header, SPARTN_LOG_SYNC, 4) != 0)
+        {
+            std::cerr << "Replay: lost record sync in " << name << " after " << record_count << " records" << std::endl;
+            return false;
+        }
+        record_time = get_le(header + 8, 8);
+        record.resize(get_le(header + 4, 4));
+        file.read((char *)record.data(), record.size());
+        if ((size_t)file.gcount() != record.size())
+            return false;
+    }
+
+    if (record.empty())
+        return false;
+
+    has_record = true;
+    record_count++;
+    byte_count += record.size();
+    return true;
+}
@@ -0,0 +1,174 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "rtcm3.hpp"
+#include "utils.hpp"
+#include <iomanip>
+
+Rtcm3Scan Rtcm3Stats::scan(const uint8_t *data, size_t size)
+{
+    Rtcm3Scan result;
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const uint8_t *frame = data + pos;
+        size_t left = size - pos;
+
+        // Look for the next preamble followed by zero reserved bits
+        if (frame[0] != RTCM3_PREAMBLE || (left > 1 && (frame[1] & 0xFC) != 0))
+        {
+            result.skipped_bytes++;
+            pos++;
+            continue;
+        }
+        if (left < RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE)
+        {
+            result.truncated_bytes += left;
+            break;
+        }
+
+        size_t length = rtcm3_getbitu(frame, 14, 10);
+        size_t total = RTCM3_HEADER_SIZE + length + RTCM3_CRC_SIZE;
+        if (total > left)
+        {
+            result.truncated_bytes += left;
+            break;
+        }
+
+        if (crc24q(frame, RTCM3_HEADER_SIZE + length) != rtcm3_getbitu(frame, (RTCM3_HEADER_SIZE + length) * 8, 24))
+        {
+            // Resynchronise on the next preamble
+            result.crc_errors++;
+            result.skipped_bytes++;
+            pos++;
+            continue;
+        }
+
+        uint16_t type = length >= 2 ? rtcm3_getbitu(frame, RTCM3_HEADER_SIZE * 8, 12) : 0;
+        if (result.id_count < RTCM3_SCAN_IDS)
+            result.ids[result.id_count++] = type;
+        result.frames++;
+
+        TypeCounters &counters = types[type];
+        if (counters.frames.fetch_add(1, std::memory_order_relaxed) == 0)
+            counters.first_ns.store(now, std::memory_order_relaxed);
+        counters.bytes.fetch_add(total, std::memory_order_relaxed);
+        counters.last_ns.store(now, std::memory_order_relaxed);
+
+        pos += total;
+    }
+
+    frame_count.fetch_add(result.frames, std::memory_order_relaxed);
+    crc_errors.fetch_add(result.crc_errors, std::memory_order_relaxed);
+    skipped_bytes.fetch_add(result.skipped_bytes, std::memory_order_relaxed);
+    truncated_bytes.fetch_add(result.truncated_bytes, std::memory_order_relaxed);
+    return result;
+}
+
+rtcm3_priority rtcm3_message_priority(uint16_t type)
+{
+    switch (type)
+    {
+    case 1005: case 1006: case 1007: case 1008: case 1033: case 1230: // station and antenna
+    case 1019: case 1020: case 1041: case 1042: case 1044: case 1045: case 1046: // ephemerides
+        return RTCM3_PRIORITY_HIGH;
+    default:
+        break;
+    }
+
+    // Legacy GPS/GLONASS observations and MSM of every constellation
+    if ((type >= 1001 && type <= 1004) || (type >= 1009 && type <= 1012) || (type >= 1071 && type <= 1137))
+        return RTCM3_PRIORITY_NORMAL;
+    return RTCM3_PRIORITY_LOW;
+}
+
+size_t rtcm3_append_frames(const uint8_t *data, size_t size, rtcm3_priority min_priority, std::vector<uint8_t> &out)
+{
+    if (min_priority == RTCM3_PRIORITY_LOW)
+    {
+        out.insert(out.end(), data, data + size);
+        return 0;
+    }
+
+    size_t dropped = 0;
+    size_t pos = 0;
+    while (pos + RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE <= size)
+    {
+        const uint8_t *frame = data + pos;
+        if (frame[0] != RTCM3_PREAMBLE)
+        {
+            pos++;
+            continue;
+        }
+
+        size_t length = rtcm3_getbitu(frame, 14, 10);
+        size_t total = RTCM3_HEADER_SIZE + length + RTCM3_CRC_SIZE;
+        if (pos + total > size)
+            break;
+
+        uint16_t type = length >= 2 ? rtcm3_getbitu(frame, RTCM3_HEADER_SIZE * 8, 12) : 0;
+        if (rtcm3_message_priority(type) >= min_priority)
+            out.insert(out.end(), frame, frame + total);
+        else
+            dropped++;
+        pos += total;
+    }
+    return dropped;
+}
+
+double Rtcm3Stats::rate(uint16_t type) const
+{
+    const TypeCounters &counters = types[type % RTCM3_MESSAGE_TYPES];
+    uint64_t count = counters.frames.load(std::memory_order_relaxed);
+    int64_t span = counters.last_ns.load(std::memory_order_relaxed) - counters.first_ns.load(std::memory_order_relaxed);
+    if (count < 2 || span <= 0)
+        return 0;
+    return (count - 1) * 1e9 / span;
+}
+
+void Rtcm3Stats::print(std::ostream &os, const std::string &name) const
+{
+    os << "  *" << std::left << std::setw(24) << name << std::right
+       << "frames=" << total_frames() << " crc_errors=" << total_crc_errors()
+       << " skipped_bytes=" << total_skipped_bytes() << " truncated_bytes=" << total_truncated_bytes() << std::endl;
+
+    for (int type = 0; type < RTCM3_MESSAGE_TYPES; type++)
+    {
+        uint64_t count = frames(type);
+        if (count == 0)
+            continue;
+        os << "    " << std::setw(4) << type << "  frames=" << count << " bytes=" << bytes(type)
+           << " rate=" << std::fixed << std::setprecision(2) << rate(type) << "Hz" << std::defaultfloat << std::endl;
+    }
+}
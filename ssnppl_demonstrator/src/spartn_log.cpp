@@ -0,0 +1,333 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "spartn_log.hpp"
+#include "log.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// GPS time started on 1980-01-06, it runs ahead of UTC by the leap seconds
+#define GPS_EPOCH_UNIX 315964800
+#define GPS_LEAP_SECONDS 18
+#define HOURS_PER_GPS_WEEK 168
+
+static uint64_t current_gps_hour()
+{
+    int64_t unix_seconds = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return (unix_seconds - GPS_EPOCH_UNIX + GPS_LEAP_SECONDS) / 3600;
+}
+
+static void put_le(char *out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        out[i] = (char)(value >> (8 * i));
+}
+
+SpartnLogger::~SpartnLogger()
+{
+    close();
+}
+
+bool SpartnLogger::open(const std::string &base_name, const SpartnLogPolicy &policy)
+{
+    this->base_name = base_name;
+    this->policy = policy;
+
+    // Room for a few flushes, so the writer can lag behind a slow card without drops
+    buffer_capacity = std::max<size_t>(policy.flush_bytes * 4, 256 * 1024);
+    active.reserve(buffer_capacity);
+    standby.reserve(buffer_capacity);
+
+    if (policy.sync == LOG_SYNC_DIRECT)
+    {
+        direct_capacity = ((buffer_capacity + SPARTN_LOG_BLOCK - 1) / SPARTN_LOG_BLOCK + 1) * SPARTN_LOG_BLOCK;
+        if (posix_memalign((void **)&direct_block, SPARTN_LOG_BLOCK, direct_capacity) != 0)
+        {
+            std::cerr << "SPARTN log: cannot allocate the O_DIRECT buffer" << std::endl;
+            return false;
+        }
+    }
+
+    if (!open_file(current_gps_hour()))
+        return false;
+
+    running = true;
+    writer_thread = std::thread(&SpartnLogger::write_loop, this);
+    return true;
+}
+
+void SpartnLogger::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_buffers);
+        if (!running)
+            return;
+        running = false;
+    }
+    cv_writer.notify_one();
+    if (writer_thread.joinable())
+        writer_thread.join();
+
+    close_file();
+    free(direct_block);
+    direct_block = nullptr;
+}
+
+void SpartnLogger::log(const uint8_t *data, size_t size)
+{
+    char header[SPARTN_LOG_HEADER_SIZE];
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    memcpy(header, SPARTN_LOG_SYNC, 4);
+    put_le(header + 4, size, 4);
+    put_le(header + 8, now, 8);
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(lk_buffers);
+        if (!running)
+            return;
+        if (active.size() + sizeof(header) + size > buffer_capacity)
+        {
+            drops++;
+            return;
+        }
+        active.insert(active.end(), header, header + sizeof(header));
+        active.insert(active.end(), (const char *)data, (const char *)data + size);
+        wake = active.size() >= policy.flush_bytes;
+    }
+    records++;
+
+    if (wake)
+        cv_writer.notify_one();
+}
+
+void SpartnLogger::write_loop()
+{
+    std::unique_lock<std::mutex> lock(lk_buffers);
+    while (true)
+    {
+        cv_writer.wait_for(lock, policy.flush_interval, [this]
+                           { return !running || active.size() >= policy.flush_bytes; });
+
+        // Take the filled buffer, log() continues on the empty one while this one is written
+        active.swap(standby);
+        bool stop = !running;
+        lock.unlock();
+
+        if (!standby.empty())
+            write_batch(standby);
+        standby.clear();
+
+        if (stop)
+            return;
+        lock.lock();
+    }
+}
+
+void SpartnLogger::write_batch(const std::vector<char> &batch)
+{
+    // Rotate between batches, a batch only holds whole records
+    uint64_t gps_hour = policy.rotation == LOG_ROTATE_GPS_HOUR ? current_gps_hour() : file_hour;
+    if (gps_hour != file_hour)
+    {
+        close_file();
+        open_file(gps_hour);
+    }
+    else if (policy.rotation == LOG_ROTATE_SIZE && file_bytes > 0 && file_bytes + batch.size() > policy.rotate_bytes)
+    {
+        close_file();
+        file_index++;
+        open_file(gps_hour);
+    }
+    // Retry a file that failed to open on the previous batch
+    if (fd < 0 && !open_file(gps_hour))
+    {
+        write_errors++;
+        return;
+    }
+
+    latency_clock::time_point start = latency_clock::now();
+
+    if (policy.sync == LOG_SYNC_DIRECT)
+    {
+        // Stage behind the tail left by the previous batch and write whole blocks only
+        memcpy(direct_block + direct_fill, batch.data(), batch.size());
+        direct_fill += batch.size();
+        size_t aligned = direct_fill - direct_fill % SPARTN_LOG_BLOCK;
+        if (aligned > 0)
+        {
+            write_block(direct_block, aligned);
+            memmove(direct_block, direct_block + aligned, direct_fill - aligned);
+            direct_fill -= aligned;
+        }
+    }
+    else
+    {
+        write_block(batch.data(), batch.size());
+        if (policy.sync == LOG_SYNC_FDATASYNC)
+            fdatasync(fd);
+    }
+
+    write_time.record_since(start);
+    file_bytes += batch.size();
+    bytes += batch.size();
+}
+
+void SpartnLogger::write_block(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            write_errors++;
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+std::string SpartnLogger::file_name(uint64_t gps_hour) const
+{
+    std::ostringstream name;
+    name << base_name;
+    if (policy.rotation == LOG_ROTATE_SIZE)
+        name << "_" << std::setw(3) << std::setfill('0') << file_index;
+    else if (policy.rotation == LOG_ROTATE_GPS_HOUR)
+        name << "_" << gps_hour / HOURS_PER_GPS_WEEK << "_" << std::setw(3) << std::setfill('0') << gps_hour % HOURS_PER_GPS_WEEK;
+    name << ".bin";
+    return name.str();
+}
+
+bool SpartnLogger::open_file(uint64_t gps_hour)
+{
+    std::string name = file_name(gps_hour);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    fd = -1;
+    if (policy.sync == LOG_SYNC_DIRECT)
+    {
+        fd = ::open(name.c_str(), flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL)
+        {
+            // Not every file system supports O_DIRECT (tmpfs ...)
+            LOG_WARN("SPARTN log: O_DIRECT not supported for " << name << ", using fdatasync");
+            policy.sync = LOG_SYNC_FDATASYNC;
+        }
+    }
+    if (fd < 0)
+        fd = ::open(name.c_str(), flags, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("SPARTN log: cannot open " << name << ": " << strerror(errno));
+        return false;
+    }
+
+    file_hour = gps_hour;
+    file_bytes = 0;
+    files++;
+    return true;
+}
+
+void SpartnLogger::close_file()
+{
+    if (fd < 0)
+        return;
+
+    // The tail shorter than a block cannot go through O_DIRECT
+    if (direct_fill > 0)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        write_block(direct_block, direct_fill);
+        direct_fill = 0;
+    }
+    if (policy.sync != LOG_SYNC_NONE)
+        fdatasync(fd);
+
+    ::close(fd);
+    fd = -1;
+}
+
+void SpartnLogger::print(std::ostream &os, const std::string &name) const
+{
+    os << "  *" << std::left << std::setw(24) << name << std::right
+       << "records=" << records << " bytes=" << bytes << " drops=" << drops
+       << " files=" << files << " write_errors=" << write_errors << std::endl;
+    write_time.print(os, name + " write");
+}
+
+bool parse_log_sync(const std::string &value, log_sync &sync)
+{
+    if (value == "none")
+        sync = LOG_SYNC_NONE;
+    else if (value == "fdatasync")
+        sync = LOG_SYNC_FDATASYNC;
+    else if (value == "direct")
+        sync = LOG_SYNC_DIRECT;
+    else
+        return false;
+    return true;
+}
+
+bool parse_log_rotation(const std::string &value, SpartnLogPolicy &policy)
+{
+    if (value == "none")
+    {
+        policy.rotation = LOG_ROTATE_NONE;
+        return true;
+    }
+    if (value == "hour")
+    {
+        policy.rotation = LOG_ROTATE_GPS_HOUR;
+        return true;
+    }
+
+    char *end = nullptr;
+    unsigned long megabytes = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || megabytes == 0)
+        return false;
+
+    policy.rotation = LOG_ROTATE_SIZE;
+    policy.rotate_bytes = (uint64_t)megabytes * 1024 * 1024;
+    return true;
+}
@@ -34,41 +34,88 @@
 #include <nlohmann/json.hpp>
 #include <mosquitto.h>
 #include <cmath>
-#include <PPL_PublicInterface.h>
 #include "mqtt.hpp"
+#include "alloc_counter.hpp"
+#include "log.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <cerrno>
 
 ssnppl_error Ssnppl_demonstrator::init(int argc, char *argv[])
 {
-    if (init_option(argc, argv) != ssnppl_error::SUCCESS)
+    if (trace_phase("options", "main", [&] { return init_option(argc, argv); }) != ssnppl_error::SUCCESS)
     {
         return ssnppl_error::FAIL;
     }
+    Logger::instance().start(log_level_option);
+    init_topic_handlers();
 
-    if (init_main_comm() != ssnppl_error::SUCCESS)
+    if (options.metrics_port > 0 && !metrics.start(options.metrics_port))
     {
         return ssnppl_error::FAIL;
     }
 
-    if (init_lband_comm() != ssnppl_error::SUCCESS)
+    /*  The MQTT TLS handshake and the subscriptions (done by mqtt_on_connect) only need the options:
+        they run on their own thread while the serial ports, the PPL and the receiver are set up.
+        A replay stands in for both channels and the MQTT broker. */
+    ssnppl_error mqtt_result = ssnppl_error::SUCCESS;
+    std::thread mqtt_init;
+    if (!replaying())
     {
-        return ssnppl_error::FAIL;
+        mqtt_init = std::thread([this, &mqtt_result]
+                                { mqtt_result = trace_phase("mqtt", "network", [this] { return init_mqtt(); }); });
     }
-    if (init_ppl() != ssnppl_error::SUCCESS)
+
+    ssnppl_error local_result = init_local();
+
+    if (mqtt_init.joinable())
+        mqtt_init.join();
+
+    if (local_result != ssnppl_error::SUCCESS || mqtt_result != ssnppl_error::SUCCESS)
     {
         return ssnppl_error::FAIL;
     }
-   init_SPARTN_LOG();
-    if (init_mqtt() != ssnppl_error::SUCCESS)
+    startup_trace.mark("init_done");
+    return ssnppl_error::SUCCESS;
+}
+
+ssnppl_error Ssnppl_demonstrator::init_local()
+{
+    if (!replaying() && trace_phase("main_comm", "local", [this] { return init_main_comm(); }) != ssnppl_error::SUCCESS)
     {
         return ssnppl_error::FAIL;
     }
-   init_receiver();
 
-   
+    if (!replaying() && trace_phase("lband_comm", "local", [this] { return init_lband_comm(); }) != ssnppl_error::SUCCESS)
+    {
+        return ssnppl_error::FAIL;
+    }
+    if (trace_phase("ppl", "local", [this] { return init_ppl(); }) != ssnppl_error::SUCCESS)
+    {
+        return ssnppl_error::FAIL;
+    }
+    if (trace_phase("spartn_log", "local", [this] { return init_SPARTN_LOG(); }) != ssnppl_error::SUCCESS)
+    {
+        return ssnppl_error::FAIL;
+    }
+    if (trace_phase("rtcm_output", "local", [this] { return init_rtcm_output(); }) != ssnppl_error::SUCCESS)
+    {
+        return ssnppl_error::FAIL;
+    }
+    trace_phase("receiver", "local", [this] { init_receiver(); return ssnppl_error::SUCCESS; });
 
     return ssnppl_error::SUCCESS;
 }
 
+ssnppl_error Ssnppl_demonstrator::trace_phase(const std::string &name, const std::string &branch, const std::function<ssnppl_error()> &phase)
+{
+    latency_clock::time_point start = latency_clock::now();
+    ssnppl_error result = phase();
+    startup_trace.record(name, branch, start, result == ssnppl_error::SUCCESS);
+    return result;
+}
+
 ssnppl_error Ssnppl_demonstrator::init_option(int argc, char *argv[])
 {
     // Parse program option
@@ -78,7 +125,75 @@ ssnppl_error Ssnppl_demonstrator::init_option(int argc, char *argv[])
         // Show current program options
         showOptions(options);
 
-        std::this_thread::sleep_for(std::chrono::seconds(3));
+        if (options.ingest != "event" && options.ingest != "poll")
+        {
+            std::cout << "Please insert a correct ingest mode: event or poll." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+
+        if (!parse_log_level(options.log_level, log_level_option))
+        {
+            std::cout << "Please insert a correct log level: debug, info, warn, error or off." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+        if (log_level_option < SSNPPL_LOG_MIN_LEVEL)
+            std::cout << "Debug logs are not compiled in, build with -DSSNPPL_DEBUG_LOGS=ON." << std::endl;
+
+        if (options.queue_overflow == "block")
+        {
+            userData.message_queue.setOverflow(RING_BLOCK);
+            ephemeris_gga_queue.setOverflow(RING_BLOCK);
+            lband_queue.setOverflow(RING_BLOCK);
+            rtcm_queue.setOverflow(RING_BLOCK);
+        }
+        else if (options.queue_overflow != "drop")
+        {
+            std::cout << "Please insert a correct queue overflow policy: drop or block." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+
+        if (!parse_log_sync(options.SPARTN_Log_sync, SPARTN_log_policy.sync))
+        {
+            std::cout << "Please insert a correct SPARTN log sync policy: none, fdatasync or direct." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+        if (!parse_log_rotation(options.SPARTN_Log_rotate, SPARTN_log_policy))
+        {
+            std::cout << "Please insert a correct SPARTN log rotation: none, hour or a size in MB." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+        if (options.SPARTN_Log_flush_kb <= 0 || options.SPARTN_Log_flush_ms <= 0)
+        {
+            std::cout << "Please insert positive SPARTN log flush thresholds." << std::endl;
+            return ssnppl_error::FAIL;
+        }
+        SPARTN_log_policy.flush_bytes = options.SPARTN_Log_flush_kb * 1024;
+        SPARTN_log_policy.flush_interval = std::chrono::milliseconds(options.SPARTN_Log_flush_ms);
+
+        if (replaying())
+        {
+            if (options.replay_speed < 0)
+            {
+                std::cout << "Please insert a correct replay speed: 0 or more." << std::endl;
+                return ssnppl_error::FAIL;
+            }
+            // Deterministic replay, nothing is dropped: the replay waits for the pipeline instead
+            userData.message_queue.setOverflow(RING_BLOCK);
+            ephemeris_gga_queue.setOverflow(RING_BLOCK);
+            lband_queue.setOverflow(RING_BLOCK);
+            rtcm_queue.setOverflow(RING_BLOCK);
+
+            if (options.localized)
+            {
+                std::cout << "Localized services need the MQTT broker, disabled for the replay." << std::endl;
+                options.localized = false;
+            }
+        }
+        else if (options.main_comm == "none" || options.main_config == "none" || options.client_id == "none")
+        {
+            std::cout << "Please insert the main_comm, main_config and client_id options." << std::endl;
+            return ssnppl_error::FAIL;
+        }
     }
     catch (po::error &e)
     {
@@ -90,6 +205,33 @@ ssnppl_error Ssnppl_demonstrator::init_option(int argc, char *argv[])
     return ssnppl_error::SUCCESS;
 }
 
+// The help text spells it Ip, the code always took IP
+static bool is_ip_comm(const std::string &comm)
+{
+    return comm == "IP" || comm == "Ip";
+}
+
+// Connects to [address]@[port] and returns the receiver IP port serving the connection, "" on failure
+static std::string open_ip_channel(SerialPort &channel, const std::string &config, const std::string &fallback_port)
+{
+    std::vector<std::string> ip_parameters = split(config, '@');
+    if (ip_parameters.size() != 2)
+    {
+        std::cout << "Please insert the IP config as [address]@[port]: " << config << std::endl;
+        return "";
+    }
+    if (!channel.open_tcp_port(ip_parameters[0], ip_parameters[1]))
+        return "";
+
+    std::string receiver_port = channel.identifyPort(std::chrono::seconds(1));
+    if (receiver_port.empty())
+    {
+        LOG_WARN("No prompt from " << config << ", assuming receiver port " << fallback_port);
+        return fallback_port;
+    }
+    return receiver_port;
+}
+
 ssnppl_error Ssnppl_demonstrator::init_main_comm()
 {
 
@@ -101,16 +243,36 @@ ssnppl_error Ssnppl_demonstrator::init_main_comm()
 
         // Create serial port object and opten it
         std::cout << "Opening main channel serial port ..." << std::endl;
-        main_channel.open_serial_port(main_usb_port, main_usb_baudrate);
+        if (!main_channel.open_serial_port(main_usb_port, main_usb_baudrate))
+            return ssnppl_error::FAIL;
         options.receiver_main_port = "USB1";
+
+        // The RTCM goes back on this port unless --rtcm_output moves it away
+        if (options.rtcm_output == "none")
+            rtcm_tx.set_baud_rate(main_usb_baudrate);
+    }
+    else if (is_ip_comm(options.main_comm))
+    {
+        std::cout << "Opening main channel TCP connection ..." << std::endl;
+        options.receiver_main_port = open_ip_channel(main_channel, options.main_config, "IP10");
+        if (options.receiver_main_port.empty())
+            return ssnppl_error::FAIL;
     }
-    else if (options.main_comm != "IP")
+    else
     {
         // error
         std::cout << "Please insert a correct main channel type: USB or IP." << std::endl;
         return ssnppl_error::FAIL;
     }
 
+    // A receiver that lost power may have lost its configuration as well
+    main_channel.onReconnect([this]
+                             {
+        LOG_WARN("Main channel reconnected, configuring the receiver again");
+        if (is_ip_comm(options.main_comm))
+            identify_main_port();
+        reconfigure_after_reconnect(true); });
+
     return ssnppl_error::SUCCESS;
 }
 
@@ -126,71 +288,78 @@ ssnppl_error Ssnppl_demonstrator::init_lband_comm()
         // Create serial port object and opten it
         std::cout << "Opening lband channel serial port ...\n"
                   << std::endl;
-        lband_channel.open_serial_port(lband_usb_port, lband_usb_baudrate);
+        if (!lband_channel.open_serial_port(lband_usb_port, lband_usb_baudrate))
+            return ssnppl_error::FAIL;
+        options.receiver_lband_port = "USB2";
+    }
+    else if (is_ip_comm(options.lband_comm))
+    {
+        std::cout << "Opening lband channel TCP connection ..." << std::endl;
+        options.receiver_lband_port = open_ip_channel(lband_channel, options.lband_config, "IP11");
+        if (options.receiver_lband_port.empty())
+            return ssnppl_error::FAIL;
     }
-    else if (options.lband_comm != "IP" && options.lband_comm != "none")
+    else if (options.lband_comm != "none")
     {
         // error
         std::cout << "Please insert a correct lband channel type: USB or IP." << std::endl;
         return ssnppl_error::FAIL;
     }
 
+    // The LBand output must be routed again to the reopened port
+    lband_channel.onReconnect([this]
+                              {
+        LOG_WARN("LBand channel reconnected, configuring the LBand output again");
+        reconfigure_after_reconnect(false); });
+
     return ssnppl_error::SUCCESS;
 }
 
-ssnppl_error Ssnppl_demonstrator::init_mqtt()
+void Ssnppl_demonstrator::init_topic_handlers()
 {
-    // Auth files path information
-    const std::string caFile = options.mqtt_auth_folder + "/AmazonRootCA1.pem";
-    const std::string certFile = options.mqtt_auth_folder + "/device-" + options.client_id + "-pp-cert.crt";
-    const std::string keyFile = options.mqtt_auth_folder + "/device-" + options.client_id + "-pp-key.pem";
+    // Handlers of the subscribed topics, corrections of the continent and of the closest node are handled alike
+    topic_handlers[TOPIC_FREQ] = [this](const struct mqttMessgae &message) { handle_frequency_message(message); };
+    topic_handlers[TOPIC_KEY] = [this](const struct mqttMessgae &message) { handle_key_message(message); };
+    topic_handlers[TOPIC_CORR] = [this](const struct mqttMessgae &message) { handle_spartn_message(message); };
+    topic_handlers[TOPIC_NODE] = [this](const struct mqttMessgae &message) {
+        // Time without corrections after a node switch, until the first message of the new node
+        if (node_switch_pending && message.topic == userData.nodeTopic)
+        {
+            node_switch_gap.record(message.stamp - node_switch_at);
+            node_switch_pending = false;
+        }
+        handle_spartn_message(message);
+    };
+    topic_handlers[TOPIC_TILE] = [this](const struct mqttMessgae &message) { handle_tile_message(message); };
+    // TOPIC_NODE_WARM has no handler: the node is only subscribed to be ready, mqtt_on_message() drops its SPARTN
+}
 
-    // Connection Variables
-    const int mqtt_keepalive = 10;
-    const int mqtt_port = 8883;
-    bool clean_session = true;
+// Connection Variables
+static const int mqtt_keepalive = 10;
+static const int mqtt_port = 8883;
 
+ssnppl_error Ssnppl_demonstrator::init_mqtt()
+{
     // Initialize Moaquitto library.
     mosquitto_lib_init();
 
-    // Create MQTT Client.
-    std::cout << "\nCreating MQTT Client.\n"
-              << std::endl;
-    mosq_client = mosquitto_new(options.client_id.c_str(), clean_session, NULL);
-
-    // Check for errors.
-    if (!mosq_client)
-    {
-        std::cerr << "Failed to create new Mosquitto client" << std::endl;
-        return ssnppl_error::MQTT_ERROR;
-    }
-
-    // Configure MQTT V5 version.
-    mosquitto_int_option(mosq_client, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
-
-    int ret = mosquitto_tls_set(mosq_client, caFile.c_str(), "./", certFile.c_str(), keyFile.c_str(), NULL);
-    if (ret != MOSQ_ERR_SUCCESS)
-    {
-        std::cerr << "Failed AUTH to MQTT broker: " << mosquitto_strerror(ret) << std::endl;
-        return ssnppl_error::MQTT_ERROR;
-    }
-
     // Set the program logic mode
     userData.corrections_mode = options.mode;
     userData.region = options.region;
     userData.cv_incoming_data = &cv_incoming_data;
+    userData.lk_incoming_data = &lk_incoming_data;
     // Set Localized distribution 
     userData.localized = options.localized ;
 
-    // Setting the callbacks for the MQTT Client
-    mosquitto_message_callback_set(mosq_client, mqtt_on_message);
-    mosquitto_connect_callback_set(mosq_client, mqtt_on_connect);
-
-    // set the userData for the client instance
-    mosquitto_user_data_set(mosq_client, &userData);
+    // Create MQTT Client.
+    std::cout << "\nCreating MQTT Client.\n"
+              << std::endl;
+    mosq_client = new_mqtt_client();
+    if (!mosq_client)
+        return ssnppl_error::MQTT_ERROR;
 
     // Establish connection to the broker
-    ret = mosquitto_connect(mosq_client, options.mqtt_server.c_str(), mqtt_port, mqtt_keepalive);
+    int ret = mosquitto_connect(mosq_client, options.mqtt_server.c_str(), mqtt_port, mqtt_keepalive);
     if (ret != MOSQ_ERR_SUCCESS)
     {
         std::cerr << "Failed to connect to MQTT broker: " << mosquitto_strerror(ret) << std::endl;
@@ -210,299 +379,589 @@ ssnppl_error Ssnppl_demonstrator::init_mqtt()
     return ssnppl_error::SUCCESS;
 }
 
-ssnppl_error Ssnppl_demonstrator::switch_mqtt_server(std::string new_mqtt_server){
+// Client with the credentials and the callbacks, not connected yet
+struct mosquitto *Ssnppl_demonstrator::new_mqtt_client()
+{
+    // Auth files path information
+    const std::string caFile = options.mqtt_auth_folder + "/AmazonRootCA1.pem";
+    const std::string certFile = options.mqtt_auth_folder + "/device-" + options.client_id + "-pp-cert.crt";
+    const std::string keyFile = options.mqtt_auth_folder + "/device-" + options.client_id + "-pp-key.pem";
+    bool clean_session = true;
+
+    struct mosquitto *client = mosquitto_new(options.client_id.c_str(), clean_session, NULL);
 
-    std::cout<<"\nStop main loop of Mosquitto client" <<std::endl  ;
-     int ret = mosquitto_loop_stop(mosq_client,true);
-    if (ret != MOSQ_ERR_SUCCESS)
+    // Check for errors.
+    if (!client)
     {
-        std::cerr << "Failed to stop main loop of Mosquitto client: " << ret << std::endl;
-        return ssnppl_error::MQTT_ERROR;
+        std::cerr << "Failed to create new Mosquitto client" << std::endl;
+        return nullptr;
     }
-    std::cout<< " \nDisconnected from old MQTT broker : " << userData.mqttServer <<std::endl;
-    ret = mosquitto_disconnect(mosq_client);
+
+    // Configure MQTT V5 version.
+    mosquitto_int_option(client, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+
+    int ret = mosquitto_tls_set(client, caFile.c_str(), "./", certFile.c_str(), keyFile.c_str(), NULL);
     if (ret != MOSQ_ERR_SUCCESS)
     {
-        std::cerr << "Failed to disconnect to MQTT broker: " << mosquitto_strerror(ret) << std::endl;
-        return ssnppl_error::MQTT_ERROR;
+        std::cerr << "Failed AUTH to MQTT broker: " << mosquitto_strerror(ret) << std::endl;
+        mosquitto_destroy(client);
+        return nullptr;
     }
-    sleep(2);
-    const int mqtt_keepalive = 10;
-    const int mqtt_port = 8883;
 
-    std::cout << "\nConnect to new MQTT broker : " << new_mqtt_server  << std::endl ;
-     ret = mosquitto_connect(mosq_client, new_mqtt_server.c_str(), mqtt_port, mqtt_keepalive);
+    // Setting the callbacks for the MQTT Client
+    mosquitto_message_callback_set(client, mqtt_on_message);
+    mosquitto_connect_callback_set(client, mqtt_on_connect);
+
+    // set the userData for the client instance
+    mosquitto_user_data_set(client, &userData);
+    return client;
+}
+
+/*  Disconnects and destroys the client on another thread, the messages it already queued are still handled.
+    Not waited for here: with RING_BLOCK its network thread may be waiting in mqtt_on_message() for room
+    in the message ring, which only the dispatch thread calling this empties. */
+void Ssnppl_demonstrator::stop_mqtt_client(struct mosquitto *client)
+{
+    stopping_clients.remove_if([](const std::future<void> &stopped)
+                               { return stopped.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+    stopping_clients.push_back(std::async(std::launch::async, [client] {
+        mosquitto_disconnect(client);
+        mosquitto_loop_stop(client, false);
+        mosquitto_destroy(client);
+    }));
+}
+
+/*  Connects a second client to the new broker, it subscribes the current topics from mqtt_on_connect().
+    The previous client is only stopped by finish_mqtt_switch() once the new one delivers SPARTN,
+    so the corrections do not stop during the connection and TLS handshake. */
+ssnppl_error Ssnppl_demonstrator::switch_mqtt_server(const std::string &new_mqtt_server, const std::string &previous_node_topic)
+{
+    struct mosquitto *client = new_mqtt_client();
+    if (!client)
+        return ssnppl_error::MQTT_ERROR;
+
+    LOG_INFO("\nConnect to new MQTT broker : " << new_mqtt_server);
+    int ret = mosquitto_connect_async(client, new_mqtt_server.c_str(), mqtt_port, mqtt_keepalive);
+    if (ret == MOSQ_ERR_SUCCESS)
+        ret = mosquitto_loop_start(client);
     if (ret != MOSQ_ERR_SUCCESS)
     {
-        std::cerr << "Failed to connect to MQTT broker: " << mosquitto_strerror(ret) << std::endl;
+        LOG_ERROR("Failed to connect to MQTT broker: " << mosquitto_strerror(ret));
+        mosquitto_destroy(client);
         return ssnppl_error::MQTT_ERROR;
     }
 
-    /* Starting the client loop                                                               *
-     *   Start the main loop of the Mosquitto client. This will cause the client to connect    *
-     *   to the broker and listen for messages on the subscribed topics.                       */
-    ret = mosquitto_loop_start(mosq_client);
-    if (ret != MOSQ_ERR_SUCCESS)
+    if (mosq_draining)
     {
-        std::cerr << "Failed to start main loop of Mosquitto client: " << ret << std::endl;
-        return ssnppl_error::MQTT_ERROR;
+        // The previous switch did not complete: its client is replaced, the oldest one keeps delivering
+        stop_mqtt_client(mosq_client);
+        if (previous_node_topic != draining_node_topic && previous_node_topic != userData.nodeTopic)
+            userData.topics.unbind(previous_node_topic);
+    }
+    else
+    {
+        mosq_draining = mosq_client;
+        draining_node_topic = previous_node_topic;
+        switch_started = latency_clock::now();
     }
+    mosq_client = client;
     userData.mqttServer = new_mqtt_server;
+    mqtt_server_switches++;
 
     return ssnppl_error::SUCCESS;
 }
 
-void Ssnppl_demonstrator::handle_data()
+// First SPARTN of the new broker: the previous one is not needed anymore
+void Ssnppl_demonstrator::finish_mqtt_switch(latency_clock::time_point first_spartn)
 {
-    std::unique_lock<std::mutex> mutex{lk_incoming_data};
-    // Wait for signal of new data (MQTT or LBAND or GGA/EPH)
-    cv_incoming_data.wait(lk_incoming_data);
-  
-    // Handle MQTT
-    {
-        std::lock_guard<std::mutex> lock(userData.message_queue_mutex);
-        if (!userData.message_queue.empty())
-        {
-            struct mqttMessgae message;
-            {
-                message = userData.message_queue.front();
-
-                // Writting the payload of each topics into the struct's variables
-                std::cout << "\nNew MQTT Message reveiced." << std::endl;
-                std::cout << "  Topic Name: " << message.topic << std::endl;
-                std::cout << "  Topic Size: " << message.payloadlen << std::endl;
-                std::cout << std::endl;
-                userData.message_queue.pop();
-            }
-            // Handle message
-            if (message.topic == userData.freqTopic && update_receiver == false)
-            {
-                // Parse the JSON string
-                nlohmann::json json = nlohmann::json::parse(message.payload);
-                // JSON comes in a string format, then convert it to float (std::stof) to not lose decimals when changing the unit to Hz,
-                // translate it to int number (static_cast<int>) bc the receiver only accepts integer number and finally return it as a string (std::to_string).
-                std::string freqValue = json["frequencies"][userData.region]["current"]["value"];
-                freqInfo = std::to_string(static_cast<int>(std::stof(freqValue) * 1000000)); // in Hertz
-
-                update_receiver = true;
-            }
-            else if (message.topic == userData.keyTopic)
-            {
-                // Parse the JSON string
-                nlohmann::json json = nlohmann::json::parse(message.payload);
-                keyInfo = json["dynamickeys"]["current"]["value"]; // It is already an string
+    mqtt_switch_duration.record(first_spartn - switch_started);
+    mqtt_switch_gap.record(first_spartn - std::max(last_spartn, switch_started));
 
-                // send key
-                ePPL_ReturnStatus ePPLRet;
+    LOG_INFO(" \nDisconnected from old MQTT broker after " << std::chrono::duration_cast<std::chrono::milliseconds>(first_spartn - switch_started).count() << " ms");
+    stop_mqtt_client(mosq_draining);
+    mosq_draining = nullptr;
+    if (draining_node_topic != userData.nodeTopic)
+        userData.topics.unbind(draining_node_topic);
 
-                std::cout << "Authentication with Dynamic Key ... ";
-                ePPLRet = PPL_SendDynamicKey(keyInfo.data(), keyInfo.length());
-                if (ePPLRet != ePPL_Success)
-                {
-                    std::cerr << "FAILED. \n"
-                              << std::endl;
-                    std::cout << "PPL Authentication error: " << ePPLRet << std::endl; // Invlid lenght or format (!)
-                    std::cout << "  - Used Key:   " << keyInfo << std::endl;
-                    std::cout << "  - Key lenght: " << keyInfo.length() << std::endl;
-                }
-                else
-                {
-                    std::cout << "SUCCESS. \n"
-                              << std::endl;
-                    std::cout << "  - Used Key:   " << keyInfo << std::endl;
-                    std::cout << "  - Key lenght: " << keyInfo.length() << std::endl;
-                    std::cout << std::endl;
-                }
-            }
-            else if (message.topic == userData.corrTopic || message.topic == userData.nodeTopic)
-            {
-                std::vector<uint8_t> mqtt_data = std::vector<uint8_t>(message.payload.begin(), message.payload.end());
-                std::array<uint8_t, PPL_MAX_RTCM_BUFFER> rtcm_buffer;
-                uint32_t rtcm_size;
-                if (options.SPARTN_Logging != "none")
-                    SPARTN_file_Ip.write((char *)mqtt_data.data(), mqtt_data.size()).flush();
-
-                ePPL_ReturnStatus ePPLRet = PPL_SendSpartn(mqtt_data.data(), mqtt_data.size());
-                if ((ePPLRet) == ePPL_Success)
-                {
-                    ePPL_ReturnStatus ePPLRet = PPL_GetRTCMOutput(rtcm_buffer.data(), PPL_MAX_RTCM_BUFFER, &rtcm_size);
-                    if (rtcm_size>0)
-                    {
-                        std::unique_lock<std::mutex> lock(rtcm_queue_mutex);
-                        rtcm_queue.push(std::vector<uint8_t>(rtcm_buffer.begin(), rtcm_buffer.begin() + rtcm_size));
-                        lock.unlock();
-                        cv_rtcm.notify_one();
-                    }
+    // The messages the previous client queued before it stopped may still be duplicates
+    dedup_until = latency_clock::now() + MQTT_DEDUP_TAIL;
+}
 
-                }
-                else
-                {
-                    std::cout << "FAILED TO SEND IP DATA:  " << ePPLRet << std::endl;
-                }
-            }
-            else if (message.topic == userData.tileTopic)
-            {
-                    // Parse Payload to get all the node available in the tile
-                    nlohmann::json json = nlohmann::json::parse(message.payload);
-                    this->nodeprefix = json["nodeprefix"];
-
-                    // Replace the previous node with new ones
-                    this->tile_dict.clear();
-                    for(int i = 0 ; i < json["nodes"].size();i++){
-                        this->tile_dict.push_back(json["nodes"][i]);
-                    }
-                    // Check if the endpoint has change
-                    if (json["endpoint"] != userData.mqttServer){
-                        
-                        //Search for closest node
-                        userData.nodeTopic = new_Node_Topic();
-                        // Change the mqtt end point by disconnection the current one and connecting it to the new one
-                        std::cout << "\nSwitching MQTT Server to : " <<json["endpoint"]<<std::endl;
-                        int ret = switch_mqtt_server(json["endpoint"]);
-                        if(ret != ssnppl_error::SUCCESS){
-                            std::cout << "Failed to switch MQTT Server" <<std::endl;
-                        }                        
-                    }else{
-                        process_new_position();
-                    }
+// Called from dispatch(): a new broker that never delivers does not keep the previous client forever
+void Ssnppl_demonstrator::check_mqtt_switch()
+{
+    if (!mosq_draining || latency_clock::now() - switch_started < MQTT_SWITCH_TIMEOUT)
+        return;
+
+    LOG_WARN("No SPARTN from " << userData.mqttServer << " yet, disconnecting the previous broker anyway");
+    mqtt_switch_timeouts++;
+    stop_mqtt_client(mosq_draining);
+    mosq_draining = nullptr;
+    if (draining_node_topic != userData.nodeTopic)
+        userData.topics.unbind(draining_node_topic);
+}
 
-            }
-        }
-    }
+// While two brokers deliver the same topic, each SPARTN payload is received twice
+bool Ssnppl_demonstrator::duplicate_spartn(const struct mqttMessgae &message)
+{
+    if (!mosq_draining && latency_clock::now() >= dedup_until)
+        return false;
 
-    // Handle GGA and Ephemeris
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : message.payload)
+        hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+
+    for (uint64_t seen : recent_spartn)
     {
-        std::lock_guard<std::mutex> mutex(ephemeris_gga_mutex);
-        if (!ephemeris_gga_queue.empty())
-        {
-            std::vector<uint8_t> msg = ephemeris_gga_queue.front();
-            ePPL_ReturnStatus ePPLRet = PPL_SendRcvrData(msg.data(), msg.size());
-            if (ePPLRet != ePPL_Success)
-            {
-                std::cout << "FAILED TO SEND RCVR DATA" << std::endl;
-            }
-            else
-            {
-                std::cout << "Ephemeris Received. Size:" << msg.size() << std::endl;
-            }
-            ephemeris_gga_queue.pop();
-            
-            // parse msg to found lat and lon 
-            if (userData.localized &&( options.mode == "Dual" || options.mode == "Ip") ){
-                 std::vector<std::string> parsedGGA = split(std::string(msg.begin(),msg.end()),',');
-                if(parsedGGA.at(0) == "$GPGGA" )
-            {
+        if (seen == hash)
+            return true;
+    }
+    recent_spartn[recent_spartn_next] = hash;
+    recent_spartn_next = (recent_spartn_next + 1) % MQTT_DEDUP_WINDOW;
+    return false;
+}
 
-                //****** Check if the GPGGA is not empty (no PVT) ********
-                if (parsedGGA.at(3) == ""){
-                    return;
-                }
+bool Ssnppl_demonstrator::has_incoming_data()
+{
+    return !userData.message_queue.empty() || !ephemeris_gga_queue.empty() || !lband_queue.empty();
+}
 
-                float new_latitude = NMEAToDecimal(parsedGGA.at(2), parsedGGA.at(3));
-                float new_longitude = NMEAToDecimal(parsedGGA.at(4),parsedGGA.at(5));
-                if( abs(latitude - new_latitude) > latitude_threshold || abs(longitude - new_longitude) > longitude_threshold){
-                    std::cout<<"New position  : lat : " << new_latitude << " / lon : "<< new_longitude <<std::endl;
-                     latitude = new_latitude ;
-                     longitude = new_longitude;
-                     latitude_threshold = latitude;
-                     longitude_threshold = latitude_threshold * cos(radians(new_latitude));
-                     process_new_position();
-                 }
-            }
-            }
-        }
+void Ssnppl_demonstrator::notify_incoming_data()
+{
+    // Taking the lock orders the push before the consumer's predicate check, so no wakeup is lost
+    {
+        std::lock_guard<std::mutex> lock(lk_incoming_data);
     }
+    cv_incoming_data.notify_all();
+}
 
-    // Handle Incoming lband
-    if (options.mode == "Lb" || options.mode == "Dual")
+void Ssnppl_demonstrator::handle_data()
+{
     {
-        std::lock_guard<std::mutex> mutex(lband_queue_mutex);
-        if (!lband_queue.empty())
-        {
-            std::vector<uint8_t> msg = lband_queue.front();
-            if (options.SPARTN_Logging != "none")
-                SPARTN_file_Lb.write((char *)msg.data(), msg.size()).flush();
+        std::unique_lock<std::mutex> lock{lk_incoming_data};
+        // Wait for new data (MQTT or LBAND or GGA/EPH), the timeout lets dispatch() check its timer
+        cv_incoming_data.wait_for(lock, std::chrono::seconds(1), [this]
+                                  { return has_incoming_data(); });
+    }
 
-            ePPL_ReturnStatus ePPLRet = PPL_SendAuxSpartn(msg.data(), msg.size());
-            if (ePPLRet != ePPL_Success)
-            {
-                std::cout << "FAILED TO SEND LBAND DATA:  " << ePPLRet << std::endl;
-            }
-            else
-            {
-                std::array<uint8_t, PPL_MAX_RTCM_BUFFER> rtcm_buffer;
-                uint32_t rtcm_size = 0;
+    // Handle every message queued before the wakeup, in place in the ring slots
+    size_t batch = userData.message_queue.size();
+    size_t handled = 0;
+    for (struct mqttMessgae *message; handled < batch && (message = userData.message_queue.pop()) != nullptr; handled++)
+        handle_mqtt_message(*message);
+    userData.message_counters.on_batch(handled);
 
-                PPL_GetRTCMOutput(rtcm_buffer.data(), PPL_MAX_RTCM_BUFFER, &rtcm_size);
+    batch = ephemeris_gga_queue.size();
+    handled = 0;
+    for (RcvrChunk *frame; handled < batch && (frame = ephemeris_gga_queue.pop()) != nullptr; handled++)
+        handle_ephemeris_gga_data(*frame);
+    ephemeris_gga_counters.on_batch(handled);
 
-                if (rtcm_size>0)
-                {
-                    std::unique_lock<std::mutex> mutex(rtcm_queue_mutex);
-                    rtcm_queue.push(std::vector<uint8_t>(rtcm_buffer.begin(), rtcm_buffer.begin() + rtcm_size));
-                    mutex.unlock();
-                    cv_rtcm.notify_one();
-                }
-            }
-            lband_queue.pop();
-        }
+    if (options.mode == "Lb" || options.mode == "Dual")
+    {
+        batch = lband_queue.size();
+        handled = 0;
+        for (RcvrChunk *chunk; handled < batch && (chunk = lband_queue.pop()) != nullptr; handled++)
+            handle_lband_data(*chunk);
+        lband_counters.on_batch(handled);
     }
 }
 
-ssnppl_error Ssnppl_demonstrator::init_ppl()
+void Ssnppl_demonstrator::push_rtcm(const uint8_t *data, size_t size, latency_clock::time_point arrival, correction_source source)
 {
+    RtcmChunk *slot = rtcm_queue.begin_push();
+    if (slot == nullptr)
+        return;
+
+    slot->data.assign(data, data + size);
+    slot->arrival = arrival;
+    slot->source = source;
+    slot->queued = latency_clock::now();
+    rtcm_queue.end_push();
+    wake_rtcm_writer();
+}
 
-    std::cout << "\nInitializing Point Perfect Library ... ";
+void Ssnppl_demonstrator::wake_rtcm_writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_rtcm);
+    }
+    cv_rtcm.notify_one();
+}
 
-    ePPL_ReturnStatus ePPLRet;
+void Ssnppl_demonstrator::handle_mqtt_message(const struct mqttMessgae &message)
+{
+    // Writting the payload of each topics into the struct's variables
+    LOG_DEBUG("\nNew MQTT Message reveiced.\n  Topic Name: " << message.topic << "\n  Topic Size: " << message.payloadlen << "\n");
 
-    // Initialize PointPerfect Library
-    if (options.mode == "Ip")
+    if (message.id == TOPIC_NODE || message.id == TOPIC_CORR)
     {
-        ePPLRet = PPL_Initialize(PPL_CFG_ENABLE_IP_CHANNEL);
+        if (mosq_draining && message.client == mosq_client)
+            finish_mqtt_switch(message.stamp);
+        if (duplicate_spartn(message))
+        {
+            mqtt_duplicates++;
+            return;
+        }
+        last_spartn = message.stamp;
     }
-    else if (options.mode == "Lb")
+
+    // Handle message, the topic has been resolved to its ID in the MQTT callback
+    if (message.id > TOPIC_NONE && message.id < TOPIC_IDS && topic_handlers[message.id])
+        topic_handlers[message.id](message);
+}
+
+void Ssnppl_demonstrator::handle_frequency_message(const struct mqttMessgae &message)
+{
+    // Parse the JSON string
+    nlohmann::json json = nlohmann::json::parse(message.payload);
+    // JSON comes in a string format, then convert it to float (std::stof) to not lose decimals when changing the unit to Hz,
+    // translate it to int number (static_cast<int>) bc the receiver only accepts integer number and finally return it as a string (std::to_string).
+    std::string freqValue = json["frequencies"][userData.region]["current"]["value"];
+    std::string frequency = std::to_string(static_cast<int>(std::stof(freqValue) * 1000000)); // in Hertz
     {
-        ePPLRet = PPL_Initialize(PPL_CFG_ENABLE_AUX_CHANNEL);
+        std::lock_guard<std::mutex> lock(lk_freq_info);
+        freqInfo = frequency;
     }
-    else if (options.mode == "Dual")
+    request_lband_reconfiguration(frequency);
+}
+
+// A new connection may be served by another IP port of the receiver (IPS1, IP11 ...), the configuration is sent for it
+void Ssnppl_demonstrator::identify_main_port()
+{
+    std::string receiver_port = main_channel.identifyPort(std::chrono::seconds(1));
+    if (receiver_port.empty())
     {
-        ePPLRet = PPL_Initialize(PPL_CFG_ENABLE_IP_CHANNEL | PPL_CFG_ENABLE_AUX_CHANNEL);
+        LOG_WARN("No prompt from " << options.main_config << ", keeping receiver port " << options.receiver_main_port);
+        return;
     }
+    if (receiver_port != options.receiver_main_port)
+        LOG_INFO("Main channel now served by receiver port " << receiver_port << " instead of " << options.receiver_main_port);
+    options.receiver_main_port = receiver_port;
+}
 
-    // Tile level for Localized distribution
-        if (options.tile_level >= 2 )
-        {
-            this->tile_level = 2;
-        }
-        else if (options.tile_level <= 0)
-        {
-            this->tile_level = 0;
-        }
-        else
-        {
-            this->tile_level = options.tile_level;
-        }
+void Ssnppl_demonstrator::reconfigure_after_reconnect(bool main_channel_lost)
+{
+    if (main_channel_lost && options.send_cmds)
+        queue_receiver_config();
 
-    if (ePPLRet != ePPL_Success)
-    {
-        std::cerr << "FAILED. \n"
-                  << std::endl;
-        return PPL_FAILED;
-    }
-    else
+    // The LBand commands only once a frequency has been received
+    std::string frequency;
     {
-        std::cout << "SUCCESS. \n"
-                  << std::endl;
-        return SUCCESS;
+        std::lock_guard<std::mutex> lock(lk_freq_info);
+        frequency = freqInfo;
     }
+    if (!frequency.empty())
+        request_lband_reconfiguration(frequency);
 }
 
-void Ssnppl_demonstrator::init_receiver()
+// One L-band command sequence at a time, only the latest frequency is applied once the one in progress finishes
+void Ssnppl_demonstrator::request_lband_reconfiguration(const std::string &frequency)
 {
-    if (options.send_cmds == true)
     {
+        std::lock_guard<std::mutex> lock(lk_freq_info);
+        if (update_receiver)
+        {
+            pending_frequency = frequency;
+            return;
+        }
+        update_receiver = true;
+    }
+    reconfigure_lband(frequency);
+}
 
-        std::vector<std::string> cmds;
+void Ssnppl_demonstrator::reconfigure_lband(const std::string &frequency)
+{
+    LOG_INFO("New frq, update receiver");
+    std::string receiver_lband_port = options.receiver_lband_port.empty() ? "USB2" : options.receiver_lband_port;
+
+    // Sent by write_rtcm() one after the other as the receiver replies, RTCM keeps flowing meanwhile
+    command_engine.queue_without_reply("SSSSSSSSSSSSSSSSSSSSSSS\x0D", COMMAND_MODE_SETTLE);
+    command_engine.queue("slbb, User1, " + frequency + ", baud2400, , , Enabled\x0D"); // 1545260000
+    command_engine.queue("slsm, manual, Inmarsat, User1, User2\x0D");
+    command_engine.queue("slcs, 5555, 6959\x0D");
+    command_engine.queue("sdio, " + receiver_lband_port + ", none, LBandBeam1\x0D", [this](bool /*accepted*/)
+                         { finish_lband_reconfiguration(); });
+}
+
+void Ssnppl_demonstrator::finish_lband_reconfiguration()
+{
+    std::string frequency;
+    {
+        std::lock_guard<std::mutex> lock(lk_freq_info);
+        frequency.swap(pending_frequency);
+        if (frequency.empty())
+        {
+            update_receiver = false;
+            return;
+        }
+    }
+    // A frequency change arrived meanwhile, update_receiver stays set
+    reconfigure_lband(frequency);
+}
+
+void Ssnppl_demonstrator::handle_key_message(const struct mqttMessgae &message)
+{
+    // Parse the JSON string
+    nlohmann::json json = nlohmann::json::parse(message.payload);
+    keyInfo = json["dynamickeys"]["current"]["value"]; // It is already an string
+    startup_trace.mark("first_key");
+
+    // send key
+    ppl_status ePPLRet;
+
+    ePPLRet = ppl->send_dynamic_key(keyInfo.data(), keyInfo.length());
+    count_ppl(PPL_CALL_KEY, ePPLRet);
+    if (ePPLRet != PPL_STATUS_SUCCESS)
+    {
+        // Invlid lenght or format (!)
+        LOG_ERROR("Authentication with Dynamic Key ... FAILED. \n\nPPL Authentication error: " << ePPLRet
+                  << "\n  - Used Key:   " << keyInfo << "\n  - Key lenght: " << keyInfo.length());
+    }
+    else
+    {
+        LOG_INFO("Authentication with Dynamic Key ... SUCCESS. \n\n  - Used Key:   " << keyInfo
+                 << "\n  - Key lenght: " << keyInfo.length() << "\n");
+    }
+}
+
+void Ssnppl_demonstrator::handle_spartn_message(const struct mqttMessgae &message)
+{
+    // The payload is used in place in the queue slot, no copy until the RTCM output
+    uint64_t allocations = thread_allocations();
+    std::array<uint8_t, PPL_RTCM_BUFFER_SIZE> rtcm_buffer;
+    uint32_t rtcm_size = 0;
+    latency_clock::time_point dispatched = latency_clock::now();
+    correction_latency.record(SOURCE_MQTT, STAGE_QUEUE, dispatched - message.stamp);
+    if (options.SPARTN_Logging != "none")
+        SPARTN_file_Ip.log((const uint8_t *)message.payload.data(), message.payload.size());
+
+    ppl_status ePPLRet = ppl->send_spartn(message.payload.data(), message.payload.size());
+    count_ppl(PPL_CALL_SPARTN, ePPLRet);
+    latency_clock::time_point sent = latency_clock::now();
+    correction_latency.record(SOURCE_MQTT, STAGE_PPL_SEND, sent - dispatched);
+    if ((ePPLRet) == PPL_STATUS_SUCCESS)
+    {
+        ppl->get_rtcm_output(rtcm_buffer.data(), rtcm_buffer.size(), &rtcm_size);
+        correction_latency.record(SOURCE_MQTT, STAGE_PPL_RTCM, latency_clock::now() - sent);
+        if (rtcm_size>0)
+            push_rtcm(rtcm_buffer.data(), rtcm_size, message.stamp, SOURCE_MQTT);
+
+    }
+    else
+    {
+        LOG_LIMITED(LEVEL_ERROR, "FAILED TO SEND IP DATA:  " << ePPLRet);
+    }
+    spartn_path_allocations += thread_allocations() - allocations;
+    spartn_path_messages++;
+}
+
+void Ssnppl_demonstrator::handle_tile_message(const struct mqttMessgae &message)
+{
+    // mqtt_on_message() unsubscribed it, a client connecting from now on does not subscribe it again
+    userData.topics.drop_current(message.topic);
+
+    // Parse Payload to get all the node available in the tile, once for all the position updates
+    nlohmann::json json = nlohmann::json::parse(message.payload);
+    std::shared_ptr<TileDict> dict = std::make_shared<TileDict>();
+    dict->nodeprefix = json["nodeprefix"];
+    dict->endpoint = json["endpoint"];
+    dict->received = std::time(nullptr);
+    size_t invalid_nodes = dict->nodes.build(json["nodes"].get<std::vector<std::string>>());
+    if (invalid_nodes > 0)
+        LOG_WARN("Ignored " << invalid_nodes << " invalid node name(s) in " << message.topic);
+    tile_cache.insert(message.topic, dict);
+
+    if (message.topic == prefetch_tile_topic)
+    {
+        // Predicted next tile: kept for when the position enters it, its node can be warmed now
+        prefetch_ahead();
+        return;
+    }
+    if (message.topic == userData.tileTopic)
+        apply_tile(dict);
+}
+
+void Ssnppl_demonstrator::apply_tile(std::shared_ptr<const TileDict> dict)
+{
+    // Replace the previous node with new ones
+    current_tile = dict;
+
+    // Check if the endpoint has change
+    if (dict->endpoint != userData.mqttServer){
+        
+        // The subscriptions made ahead are on the current broker
+        warm_node("");
+        mqtt_replace_topic(&userData, mosq_client, mosq_draining, CURRENT_PREFETCH_TILE, prefetch_tile_topic, "", TOPIC_TILE);
+        prefetch_tile_topic.clear();
+
+        //Search for closest node, the new client subscribes it once connected
+        std::string previous_node_topic = userData.nodeTopic;
+        userData.nodeTopic = new_Node_Topic();
+        userData.topics.set_current(CURRENT_NODE, userData.nodeTopic, TOPIC_NODE);
+        // Change the mqtt end point by disconnection the current one and connecting it to the new one
+        LOG_INFO("\nSwitching MQTT Server to : " << dict->endpoint);
+        int ret = switch_mqtt_server(dict->endpoint, previous_node_topic);
+        if(ret != ssnppl_error::SUCCESS){
+            LOG_ERROR("Failed to switch MQTT Server");
+        }                        
+    }else{
+        process_new_position();
+    }
+}
+
+// Fix quality of a GGA sentence (6th field), -1 when it is empty
+static int gga_fix_quality(const uint8_t *sentence, size_t size)
+{
+    int field = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (sentence[i] != ',')
+            continue;
+        if (++field == 6)
+            return (i + 1 < size && sentence[i + 1] >= '0' && sentence[i + 1] <= '9') ? sentence[i + 1] - '0' : -1;
+    }
+    return -1;
+}
+
+void Ssnppl_demonstrator::handle_ephemeris_gga_data(const RcvrChunk &frame)
+{
+    ephemeris_gga_latency.record_since(frame.stamp);
+    ppl_status ePPLRet = ppl->send_rcvr_data(frame.data.data(), frame.data.size());
+    count_ppl(PPL_CALL_RCVR, ePPLRet);
+    if (ePPLRet != PPL_STATUS_SUCCESS)
+    {
+        LOG_LIMITED(LEVEL_ERROR, "FAILED TO SEND RCVR DATA");
+    }
+    else if (frame.type == FRAME_RTCM3)
+    {
+        LOG_DEBUG("Ephemeris Received. Size:" << frame.data.size());
+    }
+
+    // parse GGA to found lat and lon 
+    if (frame.type == FRAME_NMEA && frame.data.size() > 6 && std::memcmp(frame.data.data() + 3, "GGA", 3) == 0)
+    {
+        // Time to first fix: 4 is RTK fixed, 5 RTK float
+        if (!rtk_fix_seen)
+        {
+            int quality = gga_fix_quality(frame.data.data(), frame.data.size());
+            if (quality == 5)
+                startup_trace.mark("first_rtk_float");
+            else if (quality == 4)
+            {
+                startup_trace.mark("first_rtk_fix");
+                rtk_fix_seen = true;
+            }
+        }
+
+        if (userData.localized && (options.mode == "Dual" || options.mode == "Ip"))
+            process_gga(std::string(frame.data.begin(), frame.data.end()));
+    }
+}
+
+void Ssnppl_demonstrator::handle_lband_data(const RcvrChunk &chunk)
+{
+    latency_clock::time_point dispatched = latency_clock::now();
+    lband_latency.record(dispatched - chunk.stamp);
+    correction_latency.record(SOURCE_LBAND, STAGE_QUEUE, dispatched - chunk.stamp);
+    if (options.SPARTN_Logging != "none")
+        SPARTN_file_Lb.log(chunk.data.data(), chunk.data.size());
+
+    ppl_status ePPLRet = ppl->send_aux_spartn(chunk.data.data(), chunk.data.size());
+    count_ppl(PPL_CALL_AUX_SPARTN, ePPLRet);
+    latency_clock::time_point sent = latency_clock::now();
+    correction_latency.record(SOURCE_LBAND, STAGE_PPL_SEND, sent - dispatched);
+    if (ePPLRet != PPL_STATUS_SUCCESS)
+    {
+        LOG_LIMITED(LEVEL_ERROR, "FAILED TO SEND LBAND DATA:  " << ePPLRet);
+    }
+    else
+    {
+        std::array<uint8_t, PPL_RTCM_BUFFER_SIZE> rtcm_buffer;
+        uint32_t rtcm_size = 0;
+
+        ppl->get_rtcm_output(rtcm_buffer.data(), rtcm_buffer.size(), &rtcm_size);
+        correction_latency.record(SOURCE_LBAND, STAGE_PPL_RTCM, latency_clock::now() - sent);
+
+        if (rtcm_size>0)
+            push_rtcm(rtcm_buffer.data(), rtcm_size, chunk.stamp, SOURCE_LBAND);
+    }
+}
+
+ssnppl_error Ssnppl_demonstrator::init_ppl()
+{
+
+    MockPplConfig mock_config;
+    mock_config.cost_us = options.ppl_mock_cost_us;
+    mock_config.rtcm_bytes = options.ppl_mock_rtcm_bytes;
+
+    ppl.reset(create_ppl_backend(options.ppl_backend, mock_config));
+    if (!ppl)
+    {
+        std::cerr << "PPL backend " << options.ppl_backend << " is not available in this build, use: " << default_ppl_backend() << std::endl;
+        return PPL_FAILED;
+    }
+
+    std::cout << "\nInitializing Point Perfect Library (" << ppl->name() << ") ... ";
+
+    ppl_status ePPLRet = PPL_STATUS_INIT_FAILED;
+
+    // Initialize PointPerfect Library
+    if (options.mode == "Ip")
+    {
+        ePPLRet = ppl->initialize(PPL_CHANNEL_IP);
+    }
+    else if (options.mode == "Lb")
+    {
+        ePPLRet = ppl->initialize(PPL_CHANNEL_AUX);
+    }
+    else if (options.mode == "Dual")
+    {
+        ePPLRet = ppl->initialize(PPL_CHANNEL_IP | PPL_CHANNEL_AUX);
+    }
+
+    // Tile level for Localized distribution
+        if (options.tile_level >= 2 )
+        {
+            this->tile_level = 2;
+        }
+        else if (options.tile_level <= 0)
+        {
+            this->tile_level = 0;
+        }
+        else
+        {
+            this->tile_level = options.tile_level;
+        }
+        if (options.localized)
+        {
+            position_trigger.set_distance(options.distance);
+            position_trigger.set_hysteresis(options.hysteresis);
+            position_trigger.set_min_interval(options.recompute_interval);
+            size_t loaded = tile_cache.open(options.tile_cache, options.tile_cache_size, options.tile_cache_ttl);
+            if (loaded > 0)
+                LOG_INFO("Loaded " << loaded << " tile dictionaries from " << options.tile_cache);
+        }
+
+    if (ePPLRet != PPL_STATUS_SUCCESS)
+    {
+        std::cerr << "FAILED. \n"
+                  << std::endl;
+        return PPL_FAILED;
+    }
+    else
+    {
+        std::cout << "SUCCESS. \n"
+                  << std::endl;
+        return SUCCESS;
+    }
+}
+
+void Ssnppl_demonstrator::init_receiver()
+{
+    if (options.send_cmds == true && !replaying())
+    {
 
         std::cout << "Starting Receiver configuration with commands ...\n"
                   << std::endl;
@@ -512,169 +971,439 @@ void Ssnppl_demonstrator::init_receiver()
         {
 
             std::cout << "Setting Receiver to Factory Default Config. Sending => eccf, RxDefault, Current" << std::endl;
-            main_channel.sync_write("SSSSSSSSSSSSSSSSSSSSSSS\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-
-            main_channel.sync_write("eccf, RxDefault, Current\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(5));
+            command_engine.queue_without_reply("SSSSSSSSSSSSSSSSSSSSSSS\x0D", COMMAND_MODE_SETTLE);
+            command_engine.queue("eccf, RxDefault, Current\x0D", nullptr, std::chrono::seconds(10));
         }
 
-        // Basic commands
-        cmds.push_back("sdio, " + options.receiver_main_port + ", auto, RTCMv3+NMEA\x0D");
-        cmds.push_back("sr3o, " + options.receiver_main_port + ", RTCM1019+RTCM1020+RTCM1042+RTCM1046\x0D");
-        cmds.push_back("sno, Stream1, " + options.receiver_main_port + ", GGA+ZDA, sec1\x0D");
+        queue_receiver_config();
+    }
 
-        if (options.logging != "none")
-        {
+    // The readers must run before the commands are sent to catch their replies
+    write_rtcm_thread = std::thread(&Ssnppl_demonstrator::write_rtcm, this);
 
-            // Select SBF Logginf File Name
-            cmds.push_back("sfn, DSK1, FileName, " + options.logging + "\x0D");
-            if (options.SBF_Logging_Config != "none")
-            { // Get Messages and Interval
-                std::vector<std::string> SBF_Logging_Parameters = split(options.SBF_Logging_Config, '@');
-                std::string SBF_Logging_Messages = SBF_Logging_Parameters[0];
-                std::string SBF_Logging_Interval = SBF_Logging_Parameters[1];
+    if (replaying())
+    {
+        replay_thread = std::thread(&Ssnppl_demonstrator::replay_input, this);
+        return;
+    }
 
-                // SBF Stream configuration
-                cmds.push_back("sso, Stream3, DSK1, " + SBF_Logging_Messages + ", " + SBF_Logging_Interval + "\x0D");
-            }
+    if (options.ingest == "event")
+    {
+        start_event_ingest();
+        return;
+    }
 
-            if (options.NMEA_Logging_Config != "none")
-            {
-                std::vector<std::string> NMEA_Logging_Parameters = split(options.NMEA_Logging_Config, '@');
-                std::string NMEA_Logging_Messages = NMEA_Logging_Parameters[0];
-                std::string NMEA_Logging_Interval = NMEA_Logging_Parameters[1];
+    read_ephemeris_gga_data_thread = std::thread(&Ssnppl_demonstrator::read_ephemeris_gga_data, this);
 
-                // NMEA Stream configuration
-                cmds.push_back("sso, Stream3, DSK1, " + NMEA_Logging_Messages + ", " + NMEA_Logging_Interval + "\x0D");
-            }
-        }
+    if (options.mode == "Lb" || options.mode == "Dual")
+        read_lband_data_thread = std::thread(&Ssnppl_demonstrator::read_lband_data, this);
+}
 
-        // Send all configuration commands to receiver
-        // Enter command mode
-        main_channel.sync_write("SSSSSSSSSSSSSSSSSSSSSSS\x0D");
-        std::this_thread::sleep_for(std::chrono::seconds(2));
+// Output streams and logging of the receiver, queued again when the main channel is reconnected
+void Ssnppl_demonstrator::queue_receiver_config()
+{
+    std::vector<std::string> cmds;
 
-        // Send commands
-        size_t cmds_size = cmds.size();
-        std::cout << "\nTotal configuration commands to send: " + std::to_string(cmds_size) + "\n"
-                  << std::endl;
-        for (int i = 0; i < cmds_size; i++)
+    // Basic commands
+    cmds.push_back("sdio, " + options.receiver_main_port + ", auto, RTCMv3+NMEA\x0D");
+    cmds.push_back("sr3o, " + options.receiver_main_port + ", RTCM1019+RTCM1020+RTCM1042+RTCM1046\x0D");
+    cmds.push_back("sno, Stream1, " + options.receiver_main_port + ", GGA+ZDA, sec1\x0D");
+
+    if (options.logging != "none")
+    {
+
+        // Select SBF Logginf File Name
+        cmds.push_back("sfn, DSK1, FileName, " + options.logging + "\x0D");
+        if (options.SBF_Logging_Config != "none")
+        { // Get Messages and Interval
+            std::vector<std::string> SBF_Logging_Parameters = split(options.SBF_Logging_Config, '@');
+            std::string SBF_Logging_Messages = SBF_Logging_Parameters[0];
+            std::string SBF_Logging_Interval = SBF_Logging_Parameters[1];
+
+            // SBF Stream configuration
+            cmds.push_back("sso, Stream3, DSK1, " + SBF_Logging_Messages + ", " + SBF_Logging_Interval + "\x0D");
+        }
+
+        if (options.NMEA_Logging_Config != "none")
         {
-            std::cout << "Sending configuration commands: " + std::to_string(i + 1) + "/" + std::to_string(cmds_size) << " => " << cmds[i] << std::endl;
-            main_channel.sync_write(cmds[i]);
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            std::vector<std::string> NMEA_Logging_Parameters = split(options.NMEA_Logging_Config, '@');
+            std::string NMEA_Logging_Messages = NMEA_Logging_Parameters[0];
+            std::string NMEA_Logging_Interval = NMEA_Logging_Parameters[1];
+
+            // NMEA Stream configuration
+            cmds.push_back("sso, Stream3, DSK1, " + NMEA_Logging_Messages + ", " + NMEA_Logging_Interval + "\x0D");
         }
+    }
 
+    // Send all configuration commands to receiver
+    // Enter command mode
+    command_engine.queue_without_reply("SSSSSSSSSSSSSSSSSSSSSSS\x0D", COMMAND_MODE_SETTLE);
+
+    // Queue commands, write_rtcm() sends each one once the previous one is acknowledged
+    size_t cmds_size = cmds.size();
+    std::cout << "\nTotal configuration commands to send: " + std::to_string(cmds_size) + "\n"
+              << std::endl;
+    std::shared_ptr<size_t> rejected = std::make_shared<size_t>(0);
+    latency_clock::time_point config_start = latency_clock::now();
+    for (size_t i = 0; i < cmds_size; i++)
+    {
+        std::cout << "Queueing configuration command: " + std::to_string(i + 1) + "/" + std::to_string(cmds_size) << " => " << cmds[i] << std::endl;
+        command_engine.queue(cmds[i], [i, cmds_size, rejected, config_start](bool accepted)
+                             {
+            if (!accepted)
+                (*rejected)++;
+            if (i + 1 == cmds_size)
+                LOG_INFO("Receiver configuration done in "
+                         << std::chrono::duration_cast<std::chrono::milliseconds>(latency_clock::now() - config_start).count()
+                         << " ms, " << *rejected << " command(s) failed."); });
     }
+}
 
-    read_ephemeris_gga_data_thread = std::thread(&Ssnppl_demonstrator::read_ephemeris_gga_data, this);
-    write_rtcm_thread = std::thread(&Ssnppl_demonstrator::write_rtcm, this);
+void Ssnppl_demonstrator::start_event_ingest()
+{
+    // Arm both channels before running the io_service so it does not return for lack of work
+    main_channel.async_read_some([this](const uint8_t *data, size_t size)
+                                 { push_ephemeris_gga_data(data, size, latency_clock::now()); });
 
     if (options.mode == "Lb" || options.mode == "Dual")
-        read_lband_data_thread = std::thread(&Ssnppl_demonstrator::read_lband_data, this);
+        lband_channel.async_read_some([this](const uint8_t *data, size_t size)
+                                      { push_lband_data(data, size, latency_clock::now()); });
+
+    io_service_thread = std::thread([this]
+                                    { io_service.run(); });
 }
 
-void Ssnppl_demonstrator::write_rtcm()
+void Ssnppl_demonstrator::push_ephemeris_gga_data(const uint8_t *data, size_t size, latency_clock::time_point stamp)
 {
-    if (options.mode != "Ip")
+    main_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (rcvr_capture.is_open())
+        rcvr_capture.log(data, size);
+
+    // The scanner calls route_main_frame() for every complete frame of the read
+    main_stamp = stamp;
+    main_scanner.feed(data, size);
+    notify_incoming_data();
+}
+
+void Ssnppl_demonstrator::route_main_frame(const Frame &frame)
+{
+    switch (frame.type)
+    {
+    case FRAME_NMEA:
+    case FRAME_RTCM3:
     {
-        // Wait to have frq before entering loop if LBand
-        while (!update_receiver)
-            std::this_thread::yield();
+        // GGA/ZDA and ephemeris go to PPL, GGA also to position tracking
+        RcvrChunk *slot = ephemeris_gga_queue.begin_push();
+        if (slot == nullptr)
+            break;
+        slot->data.assign(frame.data, frame.data + frame.size);
+        slot->stamp = main_stamp;
+        slot->type = frame.type;
+        ephemeris_gga_queue.end_push();
+        ephemeris_gga_counters.on_push(ephemeris_gga_queue.size());
+        break;
     }
+    case FRAME_REPLY:
+        command_engine.on_reply((const char *)frame.data, frame.size);
+        echo(std::string(frame.data, frame.data + frame.size), options.echo);
+        break;
+    default:
+        // SBF blocks are not used by PPL
+        break;
+    }
+}
 
-    while (thread_running)
+void Ssnppl_demonstrator::push_lband_data(const uint8_t *data, size_t size, latency_clock::time_point stamp)
+{
+    lband_bytes.fetch_add(size, std::memory_order_relaxed);
+    RcvrChunk *slot = lband_queue.begin_push();
+    if (slot != nullptr)
     {
-        if (update_receiver)
+        slot->data.assign(data, data + size);
+        slot->stamp = stamp;
+        slot->type = FRAME_TYPES;
+        lband_queue.end_push();
+        lband_counters.on_push(lband_queue.size());
+    }
+    notify_incoming_data();
+}
+
+ssnppl_error Ssnppl_demonstrator::init_rtcm_output()
+{
+    if (options.rtcm_output == "none")
+    {
+        if (replaying())
+            std::cout << "No --rtcm_output for the replay, the RTCM messages are discarded." << std::endl;
+        return ssnppl_error::SUCCESS;
+    }
+
+    if (options.rtcm_output == "pty")
+    {
+        // A tool reading RTCM from a serial port can open the slave side
+        rtcm_output_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (rtcm_output_fd < 0 || grantpt(rtcm_output_fd) != 0 || unlockpt(rtcm_output_fd) != 0)
+        {
+            std::cerr << "Failed to create the RTCM pseudo terminal: " << strerror(errno) << std::endl;
+            return ssnppl_error::FAIL;
+        }
+        struct termios tio;
+        tcgetattr(rtcm_output_fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(rtcm_output_fd, TCSANOW, &tio);
+
+        // Nobody may be reading, never let the RTCM writer block on it
+        fcntl(rtcm_output_fd, F_SETFL, fcntl(rtcm_output_fd, F_GETFL) | O_NONBLOCK);
+        std::cout << "RTCM output on pseudo terminal: " << ptsname(rtcm_output_fd) << std::endl;
+    }
+    else
+    {
+        rtcm_output_fd = open(options.rtcm_output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (rtcm_output_fd < 0)
         {
-            std::cout << "New frq, update receiver" << std::endl;
-            main_channel.sync_write("SSSSSSSSSSSSSSSSSSSSSSS\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-            std::string receiver_lband_port = "USB2";
+            std::cerr << "Failed to open the RTCM output " << options.rtcm_output << ": " << strerror(errno) << std::endl;
+            return ssnppl_error::FAIL;
+        }
+    }
+    return ssnppl_error::SUCCESS;
+}
 
-            main_channel.sync_write("slbb, User1, " + freqInfo + ", baud2400, , , Enabled\x0D"); // 1545260000
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+void Ssnppl_demonstrator::write_receiver(const uint8_t *data, size_t size)
+{
+    if (rtcm_output_fd < 0)
+    {
+        if (!replaying())
+            main_channel.sync_write(data, size);
+        return;
+    }
 
-            main_channel.sync_write("slsm, manual, Inmarsat, User1, User2\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            main_channel.sync_write("slcs, 5555, 6959\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            main_channel.sync_write("sdio, " + receiver_lband_port + ", none, LBandBeam1\x0D");
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            update_receiver = false;
+    while (size > 0)
+    {
+        ssize_t written = write(rtcm_output_fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            rtcm_output_drops++;
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void Ssnppl_demonstrator::push_replay_message(const uint8_t *data, size_t size)
+{
+    // Same slot filling as mqtt_on_message(), on the corrections topic
+    struct mqttMessgae *slot = userData.message_queue.begin_push();
+    if (slot != nullptr)
+    {
+        slot->id = TOPIC_CORR;
+        slot->topic.assign(userData.corrTopic);
+        slot->payload.assign((const char *)data, size);
+        slot->payloadlen = size;
+        slot->stamp = latency_clock::now();
+        slot->client = nullptr;
+        userData.message_queue.end_push();
+        userData.message_counters.on_push(userData.message_queue.size());
+    }
+    notify_incoming_data();
+}
+
+void Ssnppl_demonstrator::replay_input()
+{
+    enum { REPLAY_IP, REPLAY_LB, REPLAY_RCVR, REPLAY_STREAMS };
+    const char *suffix[REPLAY_STREAMS] = {"_Ip.bin", "_Lb.bin", "_Rcvr.bin"};
+    const char *stream_name[REPLAY_STREAMS] = {"Ip", "LBand", "Receiver"};
+    bool wanted[REPLAY_STREAMS] = {options.mode == "Ip" || options.mode == "Dual",
+                                   options.mode == "Lb" || options.mode == "Dual",
+                                   true};
+
+    ReplayReader readers[REPLAY_STREAMS];
+    uint64_t first_ns = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < REPLAY_STREAMS; i++)
+    {
+        std::string file_name = options.replay + suffix[i];
+        if (!wanted[i] || !readers[i].open(file_name))
+            continue;
+
+        std::cout << "Replaying " << file_name << (readers[i].raw() ? " (no record headers, as fast as possible)" : "") << std::endl;
+        if (!readers[i].raw())
+            first_ns = std::min(first_ns, readers[i].time_ns());
+    }
+
+    // Merge the streams on their recorded time, raw captures have time 0 and go first
+    latency_clock::time_point start = latency_clock::now();
+    while (thread_running)
+    {
+        int stream = -1;
+        for (int i = 0; i < REPLAY_STREAMS; i++)
+        {
+            if (readers[i].valid() && (stream < 0 || readers[i].time_ns() < readers[stream].time_ns()))
+                stream = i;
         }
+        if (stream < 0)
+            break;
 
+        ReplayReader &reader = readers[stream];
+        if (options.replay_speed > 0 && !reader.raw())
         {
-            std::unique_lock<std::mutex> mutex(rtcm_queue_mutex);
+            std::chrono::nanoseconds offset((int64_t)((reader.time_ns() - first_ns) / options.replay_speed));
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<latency_clock::duration>(offset));
+        }
 
-            // wait for new rtcm message to send
-            cv_rtcm.wait_for(mutex, std::chrono::seconds(1), [this]
-                         { return !rtcm_queue.empty(); });
+        if (stream == REPLAY_IP)
+            push_replay_message(reader.data(), reader.size());
+        else if (stream == REPLAY_LB)
+            push_lband_data(reader.data(), reader.size(), latency_clock::now());
+        else
+            push_ephemeris_gga_data(reader.data(), reader.size(), latency_clock::now());
 
-            if(!rtcm_queue.empty())
-            {
-                auto message = rtcm_queue.front();
+        reader.next();
+    }
+
+    double elapsed = std::chrono::duration<double>(latency_clock::now() - start).count();
+    std::cout << "\nReplay finished in " << elapsed << " s" << std::endl;
+    for (int i = 0; i < REPLAY_STREAMS; i++)
+    {
+        if (readers[i].records() == 0)
+            continue;
+        std::cout << "  *" << std::left << std::setw(24) << stream_name[i] << std::right
+                  << readers[i].records() << " records, " << readers[i].bytes() << " bytes";
+        if (elapsed > 0)
+            std::cout << ", " << (uint64_t)(readers[i].records() / elapsed) << " records/s";
+        std::cout << std::endl;
+    }
+
+    replay_done = true;
+    notify_incoming_data();
+}
+
+void Ssnppl_demonstrator::write_rtcm()
+{
+    bool first_rtcm = true;
+    rtcm_batch.reserve(MAX_RTCM_QUEUE_SIZE * PPL_RTCM_BUFFER_SIZE);
+    while (thread_running)
+    {
+        // Send the next receiver command or close the current one, without waiting for its reply
+        latency_clock::time_point next_command = command_engine.poll();
+
+        {
+            std::unique_lock<std::mutex> lock(lk_rtcm);
 
-                std::vector<int> rtcm_id = identifyRTCM3MessageIDs(message.data(), message.size());
-                std::cout << "Sending RTCM3 messages";
-                if (rtcm_id.size() > 0)
+            // wait for new rtcm message to send, a command reply or a command timeout
+            latency_clock::time_point until = std::min(next_command, latency_clock::now() + std::chrono::seconds(1));
+            cv_rtcm.wait_until(lock, until, [this]
+                               { return !rtcm_queue.empty() || command_engine.ready(); });
+        }
+
+        // Coalesce every pending chunk into a single write, one syscall per burst of the PPL
+        rtcm_batch.clear();
+        size_t chunks = 0;
+        latency_clock::time_point write_start = latency_clock::now();
+        latency_clock::duration backlog = rtcm_tx.backlog(write_start);
+        bool overloaded = rtcm_tx.modeled() && backlog > RTCM_TX_BACKLOG_LIMIT;
+        for (RtcmChunk *slot; chunks < MAX_RTCM_QUEUE_SIZE && (slot = rtcm_queue.pop()) != nullptr; chunks++)
+        {
+            correction_latency.record(slot->source, STAGE_RTCM_QUEUE, write_start - slot->queued);
+            rtcm_batch_chunks[chunks] = {slot->arrival, slot->source};
+
+            // Overloaded link: an epoch followed by a newer one only keeps the messages the newer one does not replace
+            rtcm3_priority keep = RTCM3_PRIORITY_LOW;
+            if (overloaded && !rtcm_queue.empty())
+                keep = RTCM3_PRIORITY_HIGH;
+            else if (overloaded && backlog > 2 * RTCM_TX_BACKLOG_LIMIT)
+                keep = RTCM3_PRIORITY_NORMAL;
+            rtcm_stale_drops.fetch_add(rtcm3_append_frames(slot->data.data(), slot->data.size(), keep, rtcm_batch), std::memory_order_relaxed);
+        }
+        rtcm_tx.tick(write_start);
+        if (chunks == 0)
+            continue;
+
+        if (!rtcm_batch.empty())
+        {
+            // Validate and count the frames, the per type counters replace the old per message print
+            Rtcm3Scan scan = rtcm_out_stats.scan(rtcm_batch.data(), rtcm_batch.size());
+            if (scan.crc_errors > 0 || scan.skipped_bytes > 0 || scan.truncated_bytes > 0)
+            {
+                LOG_LIMITED(LEVEL_ERROR, "Invalid RTCM3 output: " << scan.crc_errors << " CRC errors, " << scan.skipped_bytes
+                            << " bytes out of frames, " << scan.truncated_bytes << " bytes truncated");
+            }
+            if (options.echo && Logger::instance().enabled(LEVEL_INFO))
+            {
+                LogLine line(LEVEL_INFO);
+                line.stream() << "Sending RTCM3 messages";
+                if (scan.id_count > 0)
                 {
-                    std::cout << ", id = ";
-                    for (int &id : rtcm_id)
-                        std::cout << id << " ";
+                    line.stream() << ", id = ";
+                    for (size_t i = 0; i < scan.id_count; i++)
+                        line.stream() << scan.ids[i] << " ";
                 }
+            }
 
-                std::cout << std::endl;
-
-                main_channel.sync_write(message.data(), message.size());
-                rtcm_queue.pop();
+            write_receiver(rtcm_batch.data(), rtcm_batch.size());
+            rtcm_bytes.fetch_add(rtcm_batch.size(), std::memory_order_relaxed);
+            rtcm_writes.fetch_add(1, std::memory_order_relaxed);
 
+            if (first_rtcm)
+            {
+                startup_trace.mark("first_rtcm");
+                first_rtcm = false;
             }
         }
+        rtcm_batched_chunks.fetch_add(chunks, std::memory_order_relaxed);
+
+        latency_clock::time_point written = latency_clock::now();
+        rtcm_tx.on_write(rtcm_batch.size(), written);
+        for (size_t i = 0; i < chunks; i++)
+        {
+            correction_latency.record(rtcm_batch_chunks[i].source, STAGE_WRITE, written - write_start);
+            correction_latency.record(rtcm_batch_chunks[i].source, STAGE_TOTAL, written - rtcm_batch_chunks[i].arrival);
+        }
     }
 }
 
+/*  In poll mode the bytes returned by a read may have waited in the driver during the previous sleep.
+    Unless the read blocked, stamp them with the end of the previous read: an upper bound of their arrival. */
+static latency_clock::time_point poll_arrival_stamp(latency_clock::time_point read_start, latency_clock::time_point previous_read_end)
+{
+    latency_clock::time_point read_end = latency_clock::now();
+    return (read_end - read_start > std::chrono::milliseconds(1)) ? read_end : previous_read_end;
+}
+
 void Ssnppl_demonstrator::read_lband_data()
 {
+    // Allocated once, only the bytes read are copied to the queue slot whose buffer is reserved at startup
+    std::vector<uint8_t> buffer(MAX_RCVR_DATA);
+    latency_clock::time_point previous_read_end = latency_clock::now();
     while (thread_running)
     {
-        size_t size = lband_channel.sync_read();
-
-        uint8_t *buff = lband_channel.getSyncBuffer();
+        latency_clock::time_point read_start = latency_clock::now();
+        size_t size = lband_channel.sync_read(buffer.data(), buffer.size());
+        latency_clock::time_point stamp = poll_arrival_stamp(read_start, previous_read_end);
+        previous_read_end = latency_clock::now();
 
-        if (!is_empty(buff, size))
-        {
-            std::lock_guard<std::mutex> mutex(lband_queue_mutex);
-
-            std::vector<uint8_t> lband_vector(buff, buff + size);
-            lband_queue.push(lband_vector);
-        }
+        if (!is_empty(buffer.data(), size))
+            push_lband_data(buffer.data(), size, stamp);
 
-        lband_channel.clearSyncBuffer();
-        cv_incoming_data.notify_all();
         std::this_thread::sleep_for(std::chrono::milliseconds(300));
     }
 }
 
 void Ssnppl_demonstrator::read_ephemeris_gga_data()
 {
+    // The scanner copies the complete frames out of it before the next read
+    std::vector<uint8_t> buffer(MAX_RCVR_DATA);
+    latency_clock::time_point previous_read_end = latency_clock::now();
     while (thread_running)
     {
-        size_t size = main_channel.sync_read();
+        latency_clock::time_point read_start = latency_clock::now();
+        size_t size = main_channel.sync_read(buffer.data(), buffer.size());
+        latency_clock::time_point stamp = poll_arrival_stamp(read_start, previous_read_end);
+        previous_read_end = latency_clock::now();
 
-        uint8_t *buff = main_channel.getSyncBuffer();
+        if (size > 0)
+            push_ephemeris_gga_data(buffer.data(), size, stamp);
 
-        if (!is_empty(buff, size))
-        {
-            std::lock_guard<std::mutex> mutex(ephemeris_gga_mutex);
-
-            std::vector<uint8_t> ephemeris_gga_vector(buff, buff + size);
-            ephemeris_gga_queue.push(ephemeris_gga_vector);
-        }
-
-        main_channel.clearSyncBuffer();
-        cv_incoming_data.notify_all();
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
 }
@@ -682,37 +1411,204 @@ void Ssnppl_demonstrator::read_ephemeris_gga_data()
 ssnppl_error Ssnppl_demonstrator::dispatch()
 {
     auto start = std::chrono::high_resolution_clock::now();
-    
+    latency_clock::time_point next_stats = latency_clock::now() + std::chrono::seconds(options.stats_interval);
+
     while (options.timer == 0 || std::chrono::high_resolution_clock::now() - start <= std::chrono::seconds(options.timer))
     {
         handle_data();
+        check_mqtt_switch();
+
+        if (options.stats_interval > 0 && latency_clock::now() >= next_stats)
+        {
+            LogLine line(LEVEL_INFO);
+            correction_latency.print_line(line.stream());
+            next_stats += std::chrono::seconds(options.stats_interval);
+        }
+
+        // The replay is over once everything it injected has gone through
+        if (replay_done && !has_incoming_data() && rtcm_queue.empty())
+            break;
     }
 
     return ssnppl_error::SUCCESS;
 }
 
-void Ssnppl_demonstrator::init_SPARTN_LOG()
+void Ssnppl_demonstrator::count_ppl(ppl_call call, ppl_status status)
+{
+    int code = (status >= 0 && status < PPL_STATUS_CODES) ? status : PPL_STATUS_CODES - 1;
+    ppl_results[call][code].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Quantiles, sum and count of a summary
+static void metric_quantiles(std::ostream &os, const char *name, const LatencyHistogram &histogram)
+{
+    os << name << "{quantile=\"0.5\"} " << histogram.percentile(50) << "\n";
+    os << name << "{quantile=\"0.99\"} " << histogram.percentile(99) << "\n";
+    os << name << "_sum " << histogram.sum_us() << "\n";
+    os << name << "_count " << histogram.count() << "\n";
+}
+
+void Ssnppl_demonstrator::collect_metrics(std::ostream &os)
+{
+    static const char *const topic_names[TOPIC_IDS] = {"key", "freq", "corr", "node", "tile", "node_warm"};
+    static const char *const ppl_call_names[PPL_CALLS] = {"dynamic_key", "spartn", "aux_spartn", "rcvr_data"};
+
+    metric_family(os, "ssnppl_mqtt_messages_total", "counter", "MQTT messages received per topic");
+    for (int id = 0; id < TOPIC_IDS; id++)
+        os << "ssnppl_mqtt_messages_total{topic=\"" << topic_names[id] << "\"} " << userData.topic_messages[id].load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_mqtt_bytes_total", "counter", "MQTT payload bytes received per topic");
+    for (int id = 0; id < TOPIC_IDS; id++)
+        os << "ssnppl_mqtt_bytes_total{topic=\"" << topic_names[id] << "\"} " << userData.topic_bytes[id].load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_mqtt_unknown_topic_messages_total", "counter", "MQTT messages of topics no longer subscribed");
+    os << "ssnppl_mqtt_unknown_topic_messages_total " << userData.unknown_topics.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_mqtt_connects_total", "counter", "Successful connections to the MQTT broker");
+    os << "ssnppl_mqtt_connects_total " << userData.connects.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_mqtt_server_switches_total", "counter", "MQTT broker changes requested by a tile");
+    os << "ssnppl_mqtt_server_switches_total " << mqtt_server_switches.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_localized_switches_total", "counter", "Tile and node topic changes of the localized service");
+    os << "ssnppl_localized_switches_total{topic=\"tile\"} " << tile_switches.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_localized_switches_total{topic=\"node\"} " << node_switches.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_localized_recomputes_total", "counter", "Tile and node recomputations after the position moved --distance");
+    os << "ssnppl_localized_recomputes_total " << position_recomputes.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_localized_hysteresis_holds_total", "counter", "Tile and node changes avoided by the hysteresis margin");
+    os << "ssnppl_localized_hysteresis_holds_total{topic=\"tile\"} " << tile_holds.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_localized_hysteresis_holds_total{topic=\"node\"} " << node_holds.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_localized_prefetches_total", "counter", "Tile dicts subscribed ahead of the position and their use");
+    os << "ssnppl_localized_prefetches_total{result=\"tile_subscribed\"} " << tile_prefetches.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_localized_prefetches_total{result=\"tile_hit\"} " << tile_prefetch_hits.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_localized_prefetches_total{result=\"node_warm_switch\"} " << warm_node_switches.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_tile_cache_hits_total", "counter", "Tile changes answered by the tile dictionary cache");
+    os << "ssnppl_tile_cache_hits_total " << tile_cache_hits.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_tile_cache_removals_total", "counter", "Tile dictionaries removed from the cache");
+    os << "ssnppl_tile_cache_removals_total{reason=\"evicted\"} " << tile_cache.evictions() << "\n";
+    os << "ssnppl_tile_cache_removals_total{reason=\"expired\"} " << tile_cache.expirations() << "\n";
+    metric_family(os, "ssnppl_tile_cache_size", "gauge", "Tile dictionaries in the cache");
+    os << "ssnppl_tile_cache_size " << tile_cache.size() << "\n";
+    metric_family(os, "ssnppl_node_switch_gap_us", "summary", "Node topic switch to its first SPARTN message, in us (bucket upper bounds)");
+    metric_quantiles(os, "ssnppl_node_switch_gap_us", node_switch_gap);
+    metric_family(os, "ssnppl_mqtt_switch_duration_us", "summary", "MQTT broker switch to the first SPARTN of the new broker, in us (bucket upper bounds)");
+    metric_quantiles(os, "ssnppl_mqtt_switch_duration_us", mqtt_switch_duration);
+    metric_family(os, "ssnppl_mqtt_switch_gap_us", "summary", "Time without SPARTN across an MQTT broker switch, in us (bucket upper bounds)");
+    metric_quantiles(os, "ssnppl_mqtt_switch_gap_us", mqtt_switch_gap);
+    metric_family(os, "ssnppl_mqtt_switch_timeouts_total", "counter", "MQTT broker switches where the new broker sent no SPARTN in time");
+    os << "ssnppl_mqtt_switch_timeouts_total " << mqtt_switch_timeouts.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_mqtt_duplicates_total", "counter", "SPARTN messages received from both brokers during a switch and dropped");
+    os << "ssnppl_mqtt_duplicates_total " << mqtt_duplicates.load(std::memory_order_relaxed) << "\n";
+
+    metric_family(os, "ssnppl_channel_bytes_total", "counter", "Bytes read from the receiver channels and RTCM bytes written");
+    os << "ssnppl_channel_bytes_total{channel=\"main\"} " << main_bytes.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_channel_bytes_total{channel=\"lband\"} " << lband_bytes.load(std::memory_order_relaxed) << "\n";
+    os << "ssnppl_channel_bytes_total{channel=\"rtcm_out\"} " << rtcm_bytes.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_channel_reconnects_total", "counter", "Reconnections of the receiver channels after a lost connection");
+    os << "ssnppl_channel_reconnects_total{channel=\"main\"} " << main_channel.reconnects() << "\n";
+    os << "ssnppl_channel_reconnects_total{channel=\"lband\"} " << lband_channel.reconnects() << "\n";
+    metric_family(os, "ssnppl_channel_outage_seconds_total", "counter", "Time the receiver channels were disconnected before a reconnection");
+    os << "ssnppl_channel_outage_seconds_total{channel=\"main\"} " << main_channel.outageTotalUs() / 1e6 << "\n";
+    os << "ssnppl_channel_outage_seconds_total{channel=\"lband\"} " << lband_channel.outageTotalUs() / 1e6 << "\n";
+    metric_family(os, "ssnppl_channel_outage_max_seconds", "gauge", "Longest disconnection of the receiver channels");
+    os << "ssnppl_channel_outage_max_seconds{channel=\"main\"} " << main_channel.outageMaxUs() / 1e6 << "\n";
+    os << "ssnppl_channel_outage_max_seconds{channel=\"lband\"} " << lband_channel.outageMaxUs() / 1e6 << "\n";
+    metric_family(os, "ssnppl_channel_write_drops_total", "counter", "Writes to a receiver channel dropped while its connection was lost");
+    os << "ssnppl_channel_write_drops_total{channel=\"main\"} " << main_channel.writeDrops() << "\n";
+
+    metric_family(os, "ssnppl_ppl_calls_total", "counter", "PPL calls per return status");
+    for (int call = 0; call < PPL_CALLS; call++)
+    {
+        for (int code = 0; code < PPL_STATUS_CODES; code++)
+        {
+            uint64_t count = ppl_results[call][code].load(std::memory_order_relaxed);
+            if (count > 0)
+                os << "ssnppl_ppl_calls_total{call=\"" << ppl_call_names[call] << "\",status=\"" << code << "\"} " << count << "\n";
+        }
+    }
+
+    metric_family(os, "ssnppl_queue_depth", "gauge", "Items waiting in the internal queues");
+    os << "ssnppl_queue_depth{queue=\"mqtt\"} " << userData.message_queue.size() << "\n";
+    os << "ssnppl_queue_depth{queue=\"gga_ephemeris\"} " << ephemeris_gga_queue.size() << "\n";
+    os << "ssnppl_queue_depth{queue=\"lband\"} " << lband_queue.size() << "\n";
+    os << "ssnppl_queue_depth{queue=\"rtcm\"} " << rtcm_queue.size() << "\n";
+    metric_family(os, "ssnppl_queue_drops_total", "counter", "Items dropped by the internal queues when full");
+    os << "ssnppl_queue_drops_total{queue=\"mqtt\"} " << userData.message_queue.drops() << "\n";
+    os << "ssnppl_queue_drops_total{queue=\"gga_ephemeris\"} " << ephemeris_gga_queue.drops() << "\n";
+    os << "ssnppl_queue_drops_total{queue=\"lband\"} " << lband_queue.drops() << "\n";
+    os << "ssnppl_queue_drops_total{queue=\"rtcm\"} " << rtcm_queue.drops() << "\n";
+
+    metric_family(os, "ssnppl_rtcm_frames_total", "counter", "RTCM3 frames written to the receiver per message type");
+    for (int type = 0; type < RTCM3_MESSAGE_TYPES; type++)
+    {
+        uint64_t frames = rtcm_out_stats.frames(type);
+        if (frames > 0)
+            os << "ssnppl_rtcm_frames_total{type=\"" << type << "\"} " << frames << "\n";
+    }
+    metric_family(os, "ssnppl_rtcm_writes_total", "counter", "Writes of coalesced RTCM to the receiver");
+    os << "ssnppl_rtcm_writes_total " << rtcm_writes.load(std::memory_order_relaxed) << "\n";
+    metric_family(os, "ssnppl_rtcm_stale_drops_total", "counter", "RTCM3 frames of old epochs dropped while the serial link was overloaded");
+    os << "ssnppl_rtcm_stale_drops_total " << rtcm_stale_drops.load(std::memory_order_relaxed) << "\n";
+    if (rtcm_tx.modeled())
+    {
+        metric_family(os, "ssnppl_rtcm_tx_utilization_percent", "gauge", "Share of the serial link baud rate used by the RTCM writes");
+        os << "ssnppl_rtcm_tx_utilization_percent " << rtcm_tx.utilization() << "\n";
+        metric_family(os, "ssnppl_rtcm_tx_bytes_in_flight", "gauge", "RTCM bytes written and not yet out of the serial line, from the baud rate");
+        os << "ssnppl_rtcm_tx_bytes_in_flight " << rtcm_tx.bytes_in_flight() << "\n";
+    }
+    metric_family(os, "ssnppl_rtcm_crc_errors_total", "counter", "RTCM3 frames with a bad CRC in the PPL output");
+    os << "ssnppl_rtcm_crc_errors_total " << rtcm_out_stats.total_crc_errors() << "\n";
+
+    metric_family(os, "ssnppl_receiver_commands_total", "counter", "Receiver commands sent and their failures");
+    os << "ssnppl_receiver_commands_total{result=\"sent\"} " << command_engine.sent_count() << "\n";
+    os << "ssnppl_receiver_commands_total{result=\"error\"} " << command_engine.error_count() << "\n";
+    os << "ssnppl_receiver_commands_total{result=\"timeout\"} " << command_engine.timeout_count() << "\n";
+    os << "ssnppl_receiver_commands_total{result=\"retry\"} " << command_engine.retry_count() << "\n";
+
+    metric_family(os, "ssnppl_correction_latency_us", "summary", "SPARTN arrival to RTCM written, in us (bucket upper bounds)");
+    for (int source = 0; source < CORRECTION_SOURCES; source++)
+    {
+        const LatencyHistogram &total = correction_latency.histogram((correction_source)source, STAGE_TOTAL);
+        std::string label = std::string("source=\"") + CorrectionLatency::source_names()[source] + "\"";
+        os << "ssnppl_correction_latency_us{" << label << ",quantile=\"0.5\"} " << total.percentile(50) << "\n";
+        os << "ssnppl_correction_latency_us{" << label << ",quantile=\"0.99\"} " << total.percentile(99) << "\n";
+        os << "ssnppl_correction_latency_us_sum{" << label << "} " << total.sum_us() << "\n";
+        os << "ssnppl_correction_latency_us_count{" << label << "} " << total.count() << "\n";
+    }
+}
+
+ssnppl_error Ssnppl_demonstrator::init_SPARTN_LOG()
 {
     // Set SPARTN Loggin, if enabled
     if (options.SPARTN_Logging != "none")
     {
-
-        // Depending on the program logic mode, open file(s)
-        if (options.mode == "Ip")
-            SPARTN_file_Ip.open(options.SPARTN_Logging + "_Ip.bin", std::ios::binary);
-        else if (options.mode == "Lb")
-            SPARTN_file_Lb.open(options.SPARTN_Logging + "_Lb.bin", std::ios::binary);
-        else if (options.mode == "Dual")
+        // Depending on the program logic mode, open file(s), each one has its own writer thread
+        if (options.mode == "Ip" || options.mode == "Dual")
+        {
+            if (!SPARTN_file_Ip.open(options.SPARTN_Logging + "_Ip", SPARTN_log_policy))
+                return ssnppl_error::FAIL;
+        }
+        if (options.mode == "Lb" || options.mode == "Dual")
         {
-            SPARTN_file_Ip.open(options.SPARTN_Logging + "_Ip.bin", std::ios::binary);
-            SPARTN_file_Lb.open(options.SPARTN_Logging + "_Lb.bin", std::ios::binary);
+            if (!SPARTN_file_Lb.open(options.SPARTN_Logging + "_Lb", SPARTN_log_policy))
+                return ssnppl_error::FAIL;
         }
     }
+
+    // Same record format as the SPARTN logs, so a session can be replayed with --replay
+    if (options.rcvr_capture != "none" && !replaying())
+    {
+        if (!rcvr_capture.open(options.rcvr_capture + "_Rcvr", SPARTN_log_policy))
+            return ssnppl_error::FAIL;
+    }
+    return ssnppl_error::SUCCESS;
 }
 
 Ssnppl_demonstrator::~Ssnppl_demonstrator()
 {
     thread_running = false;
+    metrics.stop();
+
+    // Release the producers blocked on a full queue
+    userData.message_queue.close();
+    ephemeris_gga_queue.close();
+    lband_queue.close();
+    rtcm_queue.close();
 
     // Stop MQTT
     if (mosq_client != nullptr)
@@ -720,45 +1616,226 @@ Ssnppl_demonstrator::~Ssnppl_demonstrator()
         mosquitto_disconnect(mosq_client);
         mosquitto_loop_stop(mosq_client, true);
     }
+    if (mosq_draining != nullptr)
+    {
+        mosquitto_disconnect(mosq_draining);
+        mosquitto_loop_stop(mosq_draining, true);
+    }
+    // The closed message ring does not block their network threads anymore
+    stopping_clients.clear();
 
     if (SPARTN_file_Ip.is_open()) SPARTN_file_Ip.close();
     if (SPARTN_file_Lb.is_open()) SPARTN_file_Lb.close();
+    tile_cache.close();
+
+    if (replay_thread.joinable()) replay_thread.join();
+
+    io_service.stop();
+    if (io_service_thread.joinable()) io_service_thread.join();
+
+    if (read_ephemeris_gga_data_thread.joinable()) read_ephemeris_gga_data_thread.join();
+    if (read_lband_data_thread.joinable()) read_lband_data_thread.join();
+    if (write_rtcm_thread.joinable()) write_rtcm_thread.join();
+
+    rcvr_capture.close();
+    if (rtcm_output_fd >= 0) ::close(rtcm_output_fd);
+
+    // Writes the pending log lines, the statistics below go straight to the console
+    Logger::instance().stop();
+
+    std::cout << "\nINGEST LATENCY (" << options.ingest << " mode, read to PPL):" << std::endl;
+    ephemeris_gga_latency.print(std::cout, "GGA/Ephemeris");
+    lband_latency.print(std::cout, "LBand");
+
+    std::cout << "\nCORRECTION LATENCY (SPARTN arrival to RTCM written):" << std::endl;
+    correction_latency.print(std::cout);
 
+    std::cout << "\nQUEUES (batched dispatch):" << std::endl;
+    userData.message_counters.print(std::cout, "MQTT", userData.message_queue.drops());
+    ephemeris_gga_counters.print(std::cout, "GGA/Ephemeris", ephemeris_gga_queue.drops());
+    lband_counters.print(std::cout, "LBand", lband_queue.drops());
+    std::cout << "  *RTCM drops:             " << rtcm_queue.drops() << std::endl;
 
-    read_ephemeris_gga_data_thread.join();
-    read_lband_data_thread.join();
-    write_rtcm_thread.join();
+    std::cout << "\nSTARTUP:" << std::endl;
+    startup_trace.print(std::cout);
+    if (options.startup_trace != "none")
+        startup_trace.write(options.startup_trace);
+
+    std::cout << "\nCHANNELS:" << std::endl;
+    std::cout << "  *Main reconnects:        " << main_channel.reconnects() << " outage total=" << main_channel.outageTotalUs() / 1000
+              << "ms max=" << main_channel.outageMaxUs() / 1000 << "ms" << std::endl;
+    std::cout << "  *Main write drops:       " << main_channel.writeDrops() << std::endl;
+    std::cout << "  *LBand reconnects:       " << lband_channel.reconnects() << " outage total=" << lband_channel.outageTotalUs() / 1000
+              << "ms max=" << lband_channel.outageMaxUs() / 1000 << "ms" << std::endl;
+
+    if (userData.localized)
+    {
+        std::cout << "\nLOCALIZED SERVICE:" << std::endl;
+        std::cout << "  *Position recomputes:    " << position_recomputes << " (every " << options.distance << " m)" << std::endl;
+        std::cout << "  *Tile / node switches:   " << tile_switches << " / " << node_switches << std::endl;
+        std::cout << "  *Hysteresis holds:       " << tile_holds << " tile, " << node_holds << " node" << std::endl;
+        std::cout << "  *Tiles prefetched:       " << tile_prefetches << ", " << tile_prefetch_hits << " entered" << std::endl;
+        std::cout << "  *Warm node switches:     " << warm_node_switches << std::endl;
+        std::cout << "  *Tile cache:             " << tile_cache_hits << " hits, " << tile_cache.size() << " tiles, "
+                  << tile_cache.evictions() << " evicted, " << tile_cache.expirations() << " expired, " << tile_cache.write_errors() << " write errors" << std::endl;
+        node_switch_gap.print(std::cout, "Node switch gap");
+        std::cout << "  *Broker switches:        " << mqtt_server_switches << ", " << mqtt_switch_timeouts << " timed out, "
+                  << mqtt_duplicates << " duplicates dropped" << std::endl;
+        mqtt_switch_duration.print(std::cout, "Broker switch");
+        mqtt_switch_gap.print(std::cout, "Broker switch gap");
+    }
+
+    std::cout << "\nRECEIVER COMMANDS:" << std::endl;
+    command_engine.print(std::cout, "Main channel");
+
+    std::cout << "\nRTCM3 OUTPUT:" << std::endl;
+    rtcm_out_stats.print(std::cout, "Sent to receiver");
+    std::cout << "  *Writes:                 " << rtcm_writes << " for " << rtcm_batched_chunks << " PPL outputs" << std::endl;
+    std::cout << "  *Stale frames dropped:   " << rtcm_stale_drops << std::endl;
+    if (rtcm_tx.modeled())
+        std::cout << "  *Serial TX busy:         " << rtcm_tx.busy_total_us() / 1000 << " ms, " << rtcm_tx.utilization() << "% of the last window" << std::endl;
+
+    std::cout << "\nMQTT MESSAGE BUFFERS:" << std::endl;
+    std::cout << "  *Slot buffer growths:    " << userData.message_allocations << std::endl;
+    std::cout << "  *Unknown topics:         " << userData.unknown_topics << std::endl;
+    if (allocation_counting_enabled())
+        std::cout << "  *SPARTN path allocations:" << spartn_path_allocations << " in " << spartn_path_messages << " messages" << std::endl;
+
+    if (options.SPARTN_Logging != "none")
+    {
+        std::cout << "\nSPARTN LOG (" << options.SPARTN_Log_sync << "):" << std::endl;
+        if (options.mode == "Ip" || options.mode == "Dual")
+            SPARTN_file_Ip.print(std::cout, "Ip");
+        if (options.mode == "Lb" || options.mode == "Dual")
+            SPARTN_file_Lb.print(std::cout, "LBand");
+    }
+    if (options.rcvr_capture != "none" && !replaying())
+    {
+        std::cout << "\nRECEIVER CAPTURE:" << std::endl;
+        rcvr_capture.print(std::cout, "Main channel");
+    }
+    if (ppl)
+        ppl->print(std::cout);
+    if (rtcm_output_fd >= 0)
+        std::cout << "\nRTCM output drops:          " << rtcm_output_drops << std::endl;
 }
 
 
 // Localized Distribution Functions
 
 
+// Size of the tiles in degrees: 10, 5 and 2.5 from level 0 to 2
+static float tile_scale(int tile_level)
+{
+    return (float)  (1000 >> (tile_level & 3)) / 100.0;
+}
+
+// Dict topic of the tile holding the position
+static std::string tile_topic(int tile_level, float latitude, float longitude)
+{
+    char latitude_direction = (latitude < 0) ? 'S' : 'N' ;
+    char longitude_direction = (longitude < 0) ? 'W' : 'E' ;
+    float scale = tile_scale(tile_level);
+    
+    float tileLat  = (floor(latitude / scale) * scale) + (scale/2);
+    float tileLon  = (floor(longitude / scale) * scale) + (scale/2);
+
+    int final_tile_Lat = abs(round(tileLat * 100));
+    int final_tile_Lon = abs(round(tileLon * 100));
+
+    std::ostringstream result ;
+    result << "pp/ip/L" << tile_level << latitude_direction ;
+    result << std::setw(4) << std::setfill('0') << final_tile_Lat;
+    result << longitude_direction;
+    result << std::setw(5) << std::setfill('0') << final_tile_Lon ;
+    result << "/dict";
+    return result.str(); 
+}
+
+// UTC time of a GGA sentence (hhmmss.ss) in seconds of the day, -1 when it is empty or malformed
+static double gga_time_of_day(const std::string &field)
+{
+    // The sentence passed its checksum but may still hold anything, nothing here throws
+    if (field.size() < 6)
+        return -1;
+    for (size_t i = 0; i < 6; i++)
+    {
+        if (field[i] < '0' || field[i] > '9')
+            return -1;
+    }
+    int hours = (field[0] - '0') * 10 + (field[1] - '0');
+    int minutes = (field[2] - '0') * 10 + (field[3] - '0');
+    char *end = nullptr;
+    double seconds = std::strtod(field.c_str() + 4, &end);
+    if (*end != '\0' || hours > 23 || minutes > 59 || seconds >= 61)
+        return -1;
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+void Ssnppl_demonstrator::process_gga(const std::string &sentence)
+{
+    std::vector<std::string> parsedGGA = split(sentence, ',');
+
+    //****** Check if the GGA is not empty (no PVT) ********
+    if (parsedGGA.size() < 6 || parsedGGA.at(3) == ""){
+        return;
+    }
+
+    float new_latitude = NMEAToDecimal(parsedGGA.at(2), parsedGGA.at(3));
+    float new_longitude = NMEAToDecimal(parsedGGA.at(4),parsedGGA.at(5));
+    double fix_time = gga_time_of_day(parsedGGA.at(1));
+    if (fix_time >= 0)
+        motion.add_fix(new_latitude, new_longitude, fix_time);
+
+    // Moved --distance meters since the tile and node were computed
+    if (position_trigger.update(new_latitude, new_longitude, fix_time)){
+        LOG_INFO("New position  : lat : " << new_latitude << " / lon : " << new_longitude);
+         latitude = new_latitude ;
+         longitude = new_longitude;
+         position_recomputes++;
+         process_new_position();
+     }
+    prefetch_ahead();
+}
+
 void Ssnppl_demonstrator::process_new_position () noexcept
 {
     // Search for current tile 
     std::string new_tile_topic = new_Tile_Topic();
+    if (new_tile_topic != userData.tileTopic && !userData.tileTopic.empty() &&
+        position_trigger.keep_tile(latitude, longitude, tile_latitude, tile_longitude, tile_scale(tile_level)))
+    {
+        // Just across the border: the current tile is kept
+        new_tile_topic = userData.tileTopic;
+        tile_holds++;
+    }
     if (new_tile_topic != userData.tileTopic)
     {   //Current tile changed 
-        // Unsubscribe from current tile topic 
-        if (userData.tileTopic != ""){
-            int result = mosquitto_unsubscribe(mosq_client,NULL,userData.tileTopic.c_str());
-            if (result != MOSQ_ERR_SUCCESS) {
-                    std::cerr << "\nError unsubscribing to " << userData.tileTopic.c_str() << " topic.\n" << std::endl;
-
-                } else { 
-                    std::cout << "unsubscribed from topic: " << userData.tileTopic.c_str() << std::endl;
-                }
+        // Dict known from an earlier visit or prefetched ahead of the position: no round trip to the broker
+        std::shared_ptr<const TileDict> cached = tile_cache.find(new_tile_topic);
+        bool prefetched = new_tile_topic == prefetch_tile_topic;
+        if (prefetched)
+        {
+            // Its subscription, if its dict is still awaited, now serves the current tile
+            userData.topics.set_current(CURRENT_PREFETCH_TILE, "", TOPIC_TILE);
+            prefetch_tile_topic.clear();
         }
-        // Subscribe to new tile topic
+
+        // Unsubscribe from current tile topic, subscribe to the new one unless its dict is known
+        mqtt_replace_topic(&userData, mosq_client, mosq_draining, CURRENT_TILE, userData.tileTopic, cached ? "" : new_tile_topic, TOPIC_TILE);
         userData.tileTopic = new_tile_topic;
-        int result = mosquitto_subscribe(mosq_client,NULL,userData.tileTopic.c_str(),userData.tileQoS) ;
-        if (result != MOSQ_ERR_SUCCESS) {
-                std::cerr << "\nError subscribing to " << userData.tileTopic.c_str() << " topic.\n" << std::endl;
+        tile_latitude = latitude;
+        tile_longitude = longitude;
+        tile_switches++;
 
-            } else { 
-                std::cout << "Subscribed to topic: " << userData.tileTopic.c_str() << std::endl;
-            }
+        if (cached)
+        {
+            tile_cache_hits++;
+            if (prefetched)
+                tile_prefetch_hits++;
+            LOG_INFO("Tile dictionary from the cache: " << new_tile_topic);
+            apply_tile(cached);
+        }
     }else {
         // Check if need to change Node topic
         process_new_node();
@@ -772,77 +1849,116 @@ void Ssnppl_demonstrator::process_new_node() noexcept
     std::string new_node_topic = new_Node_Topic();
     if (new_node_topic != this->userData.nodeTopic)
     {
-        //New node topic found
-        // Unsubscribe from current node topic 
-        if (this->userData.nodeTopic !=""){
-            int result = mosquitto_unsubscribe(mosq_client,NULL,userData.nodeTopic.c_str());
-            if (result != MOSQ_ERR_SUCCESS) {
-                std::cerr << "\nError unsubscribing to " << userData.nodeTopic.c_str() << " topic.\n" << std::endl;
-
-            } else { 
-                std::cout << "unsubscribed from topic: " << userData.nodeTopic.c_str() << std::endl;
-            }
+        // Subscribed ahead: its messages are already flowing, subscribing it again only changes their handler
+        if (new_node_topic == warm_node_topic)
+        {
+            userData.topics.set_current(CURRENT_WARM_NODE, "", TOPIC_NODE_WARM);
+            warm_node_topic.clear();
+            warm_node_switches++;
+            LOG_INFO("Switched to prefetched node topic: " << new_node_topic);
         }
-        // Subscribe to new node topic
+
+        // Unsubscribe from current node topic and subscribe to the new one
+        mqtt_replace_topic(&userData, mosq_client, mosq_draining, CURRENT_NODE, userData.nodeTopic, new_node_topic, TOPIC_NODE);
         userData.nodeTopic = new_node_topic;
-        int result = mosquitto_subscribe(mosq_client,NULL,userData.nodeTopic.c_str(),userData.nodeQoS) ;
-        if (result != MOSQ_ERR_SUCCESS) {
-                std::cerr << "\nError subscribing to " << userData.nodeTopic.c_str() << " topic.\n" << std::endl;
+        node_switches++;
+        node_switch_at = latency_clock::now();
+        node_switch_pending = true;
+    }
+}
 
-            } else { 
-                std::cout << "Subscribed to topic: " << userData.nodeTopic.c_str() << std::endl;
+std::string Ssnppl_demonstrator::new_Node_Topic() noexcept
+{
+    if (!current_tile)
+        return "";
+    const NodeIndex &nodes = current_tile->nodes;
+    const std::string &prefix = current_tile->nodeprefix;
+    int node = nodes.nearest(latitude, longitude);
+    if (node < 0)
+        return prefix;
+
+    // The current node is kept until another one is closer by the hysteresis margin
+    if (userData.nodeTopic.size() > prefix.size() && userData.nodeTopic.compare(0, prefix.size(), prefix) == 0)
+    {
+        int current = nodes.find(userData.nodeTopic.substr(prefix.size()));
+        if (current >= 0 && current != node)
+        {
+            float current_lat, current_lon, nearest_lat, nearest_lon;
+            nodes.position(current, current_lat, current_lon);
+            nodes.position(node, nearest_lat, nearest_lon);
+            if (position_trigger.keep_node(distanceBetweenLocations(latitude, longitude, current_lat, current_lon) * 1000,
+                                           distanceBetweenLocations(latitude, longitude, nearest_lat, nearest_lon) * 1000))
+            {
+                node_holds++;
+                node = current;
             }
+        }
     }
+    return prefix + nodes.name(node);
 }
 
-std::string Ssnppl_demonstrator::new_Node_Topic() noexcept
+std::string Ssnppl_demonstrator::new_Tile_Topic () noexcept
 {
-    
-    float min_dist_scaled = std::numeric_limits<float>::max();
-    float node_lat , node_lon ;
-    char node_ns , node_ew ;
-    float dist ;
-    std::string result ;
-    for( int i = 0 ; i < tile_dict.size() ; i++){
-        // Get the node information
-        node_ns = tile_dict.at(i).at(0);
-        node_lat = stof(tile_dict.at(i).substr(1,4))/100;
-        node_ew = tile_dict.at(i).at(5);
-        node_lon = stof(tile_dict.at(i).substr(6,11)) /100;
+    return tile_topic(tile_level, latitude, longitude);
+}
+
+/*  Subscribes ahead of the position, from its velocity: the dict of the next tile along the path,
+    and the next node once the dict of its tile is known, so that crossing into them needs no round trip. */
+void Ssnppl_demonstrator::prefetch_ahead()
+{
+    if (!motion.moving() || userData.tileTopic.empty())
+        return;
 
-        if (node_ns == 'S'){
-            node_lat = -node_lat;
+    std::string next_tile;
+    std::string next_node;
+    for (int step = 1; step <= PREFETCH_STEPS; step++)
+    {
+        float predicted_latitude, predicted_longitude;
+        motion.predict(PREFETCH_HORIZON * step / PREFETCH_STEPS, predicted_latitude, predicted_longitude);
+        std::string topic = tile_topic(tile_level, predicted_latitude, predicted_longitude);
+        if (topic != userData.tileTopic && next_tile.empty())
+            next_tile = topic;
+
+        // The node can only be found in a tile whose dict is known and served by this broker
+        std::shared_ptr<const TileDict> dict = current_tile;
+        if (topic != userData.tileTopic)
+        {
+            dict = tile_cache.find(topic);
         }
-        if (node_ew == 'W'){
-            node_lon = -node_lon;
+        if (next_node.empty() && dict && dict->endpoint == userData.mqttServer)
+        {
+            int node = dict->nodes.nearest(predicted_latitude, predicted_longitude);
+            if (node >= 0 && dict->nodeprefix + dict->nodes.name(node) != userData.nodeTopic)
+                next_node = dict->nodeprefix + dict->nodes.name(node);
         }
-        dist = distanceBetweenLocations(latitude,longitude,node_lat,node_lon);
+    }
 
-        if (dist < min_dist_scaled) {
-            min_dist_scaled = dist;
-            result = tile_dict.at(i);
-        }
+    if (next_tile != prefetch_tile_topic)
+    {
+        // The prediction changed, the previous tile is not needed anymore
+        bool fetch = !next_tile.empty() && !tile_cache.find(next_tile);
+        if (fetch)
+            LOG_INFO("Heading " << motion.heading() << " deg at " << motion.speed() << " m/s, prefetching tile: " << next_tile);
+        if (mqtt_replace_topic(&userData, mosq_client, mosq_draining, CURRENT_PREFETCH_TILE, prefetch_tile_topic, fetch ? next_tile : "", TOPIC_TILE) && fetch)
+            tile_prefetches++;
+        prefetch_tile_topic = next_tile;
     }
-    return this->nodeprefix + result;
-    
+    warm_node(next_node);
 }
-std::string Ssnppl_demonstrator::new_Tile_Topic () noexcept
-{
-    char latitude_direction = (latitude < 0) ? 'S' : 'N' ;
-    char longitude_direction = (longitude < 0) ? 'W' : 'E' ;
-    float scale =(float)  (1000 >> (tile_level & 3)) / 100.0;
-    
-    float tileLat  = (floor(latitude / scale) * scale) + (scale/2);
-    float tileLon  = (floor(longitude / scale) * scale) + (scale/2);
 
-    int final_tile_Lat = abs(round(tileLat * 100));
-    int final_tile_Lon = abs(round(tileLon * 100));
+// Subscribes to the node topic predicted next, its messages are dropped until process_new_node() switches to it
+void Ssnppl_demonstrator::warm_node(const std::string &node_topic)
+{
+    if (node_topic == warm_node_topic)
+        return;
 
-    std::ostringstream result ;
-    result << "pp/ip/L" << tile_level << latitude_direction ;
-    result << std::setw(4) << std::setfill('0') << final_tile_Lat;
-    result << longitude_direction;
-    result << std::setw(5) << std::setfill('0') << final_tile_Lon ;
-    result << "/dict";
-    return result.str(); 
+    if (!node_topic.empty())
+        LOG_INFO("Warming node topic: " << node_topic);
+    if (mqtt_replace_topic(&userData, mosq_client, mosq_draining, CURRENT_WARM_NODE, warm_node_topic, node_topic, TOPIC_NODE_WARM))
+    {
+        warm_node_topic = node_topic;
+        return;
+    }
+    userData.topics.set_current(CURRENT_WARM_NODE, "", TOPIC_NODE_WARM);
+    warm_node_topic.clear();
 }
@@ -0,0 +1,102 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "startup_trace.hpp"
+#include <nlohmann/json.hpp>
+#include <fstream>
+
+void StartupTrace::record(const std::string &name, const std::string &branch, latency_clock::time_point start, bool ok)
+{
+    latency_clock::time_point end = latency_clock::now();
+    std::lock_guard<std::mutex> lock(lk_trace);
+    phases.push_back(Phase{name, branch, since_origin(start), since_origin(end) - since_origin(start), ok});
+}
+
+void StartupTrace::mark(const std::string &milestone)
+{
+    int64_t at_us = since_origin(latency_clock::now());
+    std::lock_guard<std::mutex> lock(lk_trace);
+    for (const Milestone &seen : milestones)
+    {
+        if (seen.name == milestone)
+            return;
+    }
+    milestones.push_back(Milestone{milestone, at_us});
+}
+
+std::string StartupTrace::json() const
+{
+    std::lock_guard<std::mutex> lock(lk_trace);
+
+    nlohmann::json trace;
+    trace["phases"] = nlohmann::json::array();
+    for (const Phase &phase : phases)
+    {
+        trace["phases"].push_back({{"name", phase.name},
+                                   {"branch", phase.branch},
+                                   {"start_ms", phase.start_us / 1000.0},
+                                   {"duration_ms", phase.duration_us / 1000.0},
+                                   {"ok", phase.ok}});
+    }
+    trace["milestones"] = nlohmann::json::object();
+    for (const Milestone &milestone : milestones)
+        trace["milestones"][milestone.name + "_ms"] = milestone.at_us / 1000.0;
+
+    return trace.dump(2);
+}
+
+bool StartupTrace::write(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "Cannot open the startup trace " << path << std::endl;
+        return false;
+    }
+    file << json() << std::endl;
+    return file.good();
+}
+
+void StartupTrace::print(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(lk_trace);
+    for (const Phase &phase : phases)
+    {
+        os << "  *" << std::left << std::setw(24) << phase.name + " (" + phase.branch + ")" << std::right
+           << "start=" << phase.start_us / 1000 << "ms duration=" << phase.duration_us / 1000 << "ms"
+           << (phase.ok ? "" : " FAILED") << std::endl;
+    }
+    for (const Milestone &milestone : milestones)
+    {
+        os << "  *" << std::left << std::setw(24) << milestone.name << std::right
+           << "at=" << milestone.at_us / 1000 << "ms" << std::endl;
+    }
+}
@@ -0,0 +1,216 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "tile_cache.hpp"
+#include "log.hpp"
+#include <nlohmann/json.hpp>
+#include <cstdio>
+#include <fstream>
+
+TileCache::~TileCache()
+{
+    close();
+}
+
+size_t TileCache::open(const std::string &file, size_t max_tiles, long ttl_seconds)
+{
+    path = file;
+    capacity = max_tiles > 0 ? max_tiles : 1;
+    ttl = ttl_seconds;
+    if (path == "none")
+        return 0;
+
+    std::ifstream input(path);
+    if (!input.is_open())
+        return 0; // first run
+
+    nlohmann::json json = nlohmann::json::parse(input, nullptr, false);
+    if (!json.is_array())
+    {
+        LOG_WARN("Ignoring the unreadable tile cache " << path);
+        return 0;
+    }
+
+    std::time_t now = std::time(nullptr);
+    for (const nlohmann::json &tile : json)
+    {
+        std::shared_ptr<TileDict> dict = std::make_shared<TileDict>();
+        std::string topic;
+        try
+        {
+            topic = tile.at("topic").get<std::string>();
+            dict->nodeprefix = tile.at("nodeprefix").get<std::string>();
+            dict->endpoint = tile.at("endpoint").get<std::string>();
+            dict->received = tile.at("received").get<std::time_t>();
+            if (expired_at(*dict, now))
+                continue;
+            dict->nodes.build(tile.at("nodes").get<std::vector<std::string>>());
+        }
+        catch (const nlohmann::json::exception &error)
+        {
+            LOG_WARN("Ignoring a tile of the cache " << path << ": " << error.what());
+            continue;
+        }
+
+        // The file lists the most recently used last
+        auto duplicate = by_topic.find(topic);
+        if (duplicate != by_topic.end())
+            erase(duplicate);
+        entries.push_front(std::make_pair(topic, dict));
+        by_topic[topic] = entries.begin();
+    }
+    while (entries.size() > capacity)
+        erase(by_topic.find(entries.back().first));
+    entry_count = entries.size();
+    return entries.size();
+}
+
+void TileCache::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(lk_writer);
+        if (!running)
+            return;
+        running = false;
+    }
+    cv_writer.notify_one();
+    if (writer_thread.joinable())
+        writer_thread.join();
+}
+
+std::shared_ptr<const TileDict> TileCache::find(const std::string &topic)
+{
+    auto it = by_topic.find(topic);
+    if (it == by_topic.end())
+        return nullptr;
+
+    if (expired_at(*it->second->second, std::time(nullptr)))
+    {
+        erase(it);
+        expired++;
+        return nullptr;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    return entries.front().second;
+}
+
+void TileCache::insert(const std::string &topic, std::shared_ptr<const TileDict> dict)
+{
+    auto it = by_topic.find(topic);
+    if (it != by_topic.end())
+        erase(it);
+
+    entries.push_front(std::make_pair(topic, dict));
+    by_topic[topic] = entries.begin();
+    if (entries.size() > capacity)
+    {
+        erase(by_topic.find(entries.back().first));
+        evicted++;
+    }
+    entry_count = entries.size();
+
+    if (path == "none")
+        return;
+
+    // Only shared pointers are copied, the file is written by write_loop()
+    std::unique_ptr<snapshot> tiles(new snapshot(entries.rbegin(), entries.rend()));
+    {
+        std::lock_guard<std::mutex> lock(lk_writer);
+        if (!running)
+        {
+            running = true;
+            writer_thread = std::thread(&TileCache::write_loop, this);
+        }
+        pending.swap(tiles);
+    }
+    cv_writer.notify_one();
+}
+
+void TileCache::erase(std::map<std::string, lru_list::iterator>::iterator it)
+{
+    entries.erase(it->second);
+    by_topic.erase(it);
+    entry_count = entries.size();
+}
+
+void TileCache::write_loop()
+{
+    std::unique_lock<std::mutex> lock(lk_writer);
+    while (true)
+    {
+        cv_writer.wait(lock, [this]
+                       { return !running || pending; });
+
+        std::unique_ptr<snapshot> tiles(std::move(pending));
+        bool stop = !running;
+        lock.unlock();
+
+        if (tiles && !save(*tiles))
+        {
+            failed_writes++;
+            LOG_LIMITED(LEVEL_WARN, "Cannot write the tile cache " << path);
+        }
+
+        if (stop)
+            return;
+        lock.lock();
+    }
+}
+
+// Written to a temporary file renamed over the previous one, a crash leaves either copy complete
+bool TileCache::save(const snapshot &tiles) const
+{
+    nlohmann::json json = nlohmann::json::array();
+    for (auto it = tiles.begin(); it != tiles.end(); ++it)
+    {
+        const TileDict &dict = *it->second;
+        nlohmann::json nodes = nlohmann::json::array();
+        for (size_t i = 0; i < dict.nodes.size(); i++)
+            nodes.push_back(dict.nodes.name(i));
+        json.push_back({{"topic", it->first},
+                        {"nodeprefix", dict.nodeprefix},
+                        {"endpoint", dict.endpoint},
+                        {"received", dict.received},
+                        {"nodes", nodes}});
+    }
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream output(temporary);
+        if (!output.is_open())
+            return false;
+        output << json.dump();
+        if (!output.good())
+            return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
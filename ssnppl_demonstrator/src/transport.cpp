@@ -0,0 +1,227 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "transport.hpp"
+#include "log.hpp"
+#include <poll.h>
+#include <sys/socket.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#define SERIAL_BY_ID_DIR "/dev/serial/by-id/"
+
+static bool wait_readable_fd(int fd, std::chrono::milliseconds timeout)
+{
+    struct pollfd descriptor = {fd, POLLIN, 0};
+    return ::poll(&descriptor, 1, (int)timeout.count()) > 0 && (descriptor.revents & POLLIN);
+}
+
+static std::string real_path(const std::string &path)
+{
+    char resolved[PATH_MAX];
+    return ::realpath(path.c_str(), resolved) ? std::string(resolved) : std::string();
+}
+
+// The /dev/serial/by-id link to the same device as path, "" if there is none
+static std::string find_by_id_path(const std::string &path)
+{
+    if (path.compare(0, sizeof(SERIAL_BY_ID_DIR) - 1, SERIAL_BY_ID_DIR) == 0)
+        return path;
+
+    std::string device = real_path(path);
+    DIR *dir = ::opendir(SERIAL_BY_ID_DIR);
+    if (device.empty() || dir == nullptr)
+        return "";
+
+    std::string found;
+    while (struct dirent *entry = ::readdir(dir))
+    {
+        std::string link = std::string(SERIAL_BY_ID_DIR) + entry->d_name;
+        if (entry->d_name[0] != '.' && real_path(link) == device)
+        {
+            found = link;
+            break;
+        }
+    }
+    ::closedir(dir);
+    return found;
+}
+
+bool SerialTransport::open(boost::system::error_code &error)
+{
+    close();
+    port.open(stable_path.empty() ? device_path : stable_path, error);
+    if (error)
+        return false;
+
+    if (stable_path.empty())
+    {
+        stable_path = find_by_id_path(device_path);
+        if (!stable_path.empty() && stable_path != device_path)
+            LOG_INFO(device_path << " is " << stable_path << ", the device is reopened through it after a disconnection");
+    }
+
+    port.set_option(boost::asio::serial_port_base::baud_rate(baud_rate), error);
+    if (!error)
+        port.set_option(boost::asio::serial_port_base::character_size(8), error);
+    if (!error)
+        port.set_option(boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one), error);
+    if (!error)
+        port.set_option(boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none), error);
+    if (!error)
+        port.set_option(boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none), error);
+    if (error)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SerialTransport::close()
+{
+    boost::system::error_code ignored;
+    if (port.is_open())
+        port.close(ignored);
+}
+
+void SerialTransport::async_read_some(uint8_t *data, size_t size, read_handler handler)
+{
+    port.async_read_some(boost::asio::buffer(data, size), handler);
+}
+
+size_t SerialTransport::read_some(uint8_t *data, size_t size, boost::system::error_code &error)
+{
+    return port.read_some(boost::asio::buffer(data, size), error);
+}
+
+void SerialTransport::write(const uint8_t *data, size_t size, boost::system::error_code &error)
+{
+    boost::asio::write(port, boost::asio::buffer(data, size), error);
+}
+
+bool SerialTransport::wait_readable(std::chrono::milliseconds timeout)
+{
+    return port.is_open() && wait_readable_fd(port.native_handle(), timeout);
+}
+
+bool TcpTransport::open(boost::system::error_code &error)
+{
+    close();
+
+    boost::asio::ip::tcp::resolver resolver(io_service);
+    boost::asio::ip::tcp::resolver::iterator endpoints = resolver.resolve(boost::asio::ip::tcp::resolver::query(host, port), error);
+    if (error)
+        return false;
+
+    error = boost::asio::error::host_not_found;
+    for (boost::asio::ip::tcp::resolver::iterator end; endpoints != end; ++endpoints)
+    {
+        if (connect(endpoints->endpoint(), error))
+            break;
+        close();
+    }
+    if (error)
+        return false;
+
+    // Corrections are small frames that must leave at once, and a dead receiver must be noticed
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), error);
+    if (!error)
+        socket.set_option(boost::asio::socket_base::keep_alive(true), error);
+    if (error)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Non-blocking connect waited for with poll, so an unreachable receiver cannot stall the caller for the system timeout
+bool TcpTransport::connect(const boost::asio::ip::tcp::endpoint &endpoint, boost::system::error_code &error)
+{
+    socket.open(endpoint.protocol(), error);
+    if (!error)
+        socket.non_blocking(true, error);
+    if (error)
+        return false;
+
+    socket.connect(endpoint, error);
+    if (error == boost::asio::error::would_block || error == boost::asio::error::in_progress)
+    {
+        struct pollfd descriptor = {socket.native_handle(), POLLOUT, 0};
+        if (::poll(&descriptor, 1, (int)TRANSPORT_CONNECT_TIMEOUT.count()) <= 0)
+        {
+            error = boost::asio::error::timed_out;
+            return false;
+        }
+
+        int result = 0;
+        socklen_t length = sizeof(result);
+        ::getsockopt(socket.native_handle(), SOL_SOCKET, SO_ERROR, &result, &length);
+        error = boost::system::error_code(result, boost::system::system_category());
+    }
+    if (error)
+        return false;
+
+    socket.non_blocking(false, error);
+    return !error;
+}
+
+void TcpTransport::close()
+{
+    boost::system::error_code ignored;
+    if (socket.is_open())
+    {
+        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        socket.close(ignored);
+    }
+}
+
+void TcpTransport::async_read_some(uint8_t *data, size_t size, read_handler handler)
+{
+    socket.async_read_some(boost::asio::buffer(data, size), handler);
+}
+
+size_t TcpTransport::read_some(uint8_t *data, size_t size, boost::system::error_code &error)
+{
+    return socket.read_some(boost::asio::buffer(data, size), error);
+}
+
+void TcpTransport::write(const uint8_t *data, size_t size, boost::system::error_code &error)
+{
+    boost::asio::write(socket, boost::asio::buffer(data, size), error);
+}
+
+bool TcpTransport::wait_readable(std::chrono::milliseconds timeout)
+{
+    return socket.is_open() && wait_readable_fd(socket.native_handle(), timeout);
+}
@@ -38,11 +38,17 @@
 #include <cstring>
 #include <sstream>
 #include "utils.hpp"
+#include "log.hpp"
 
 void echo(const std::string &msg, bool echo_mode)
 {
-  if (echo_mode == true)
-    std::cout << msg;
+  if (echo_mode == true && Logger::instance().enabled(LEVEL_INFO))
+  {
+    // The logger ends the line
+    size_t end = msg.find_last_not_of("\r\n");
+    LogLine line(LEVEL_INFO);
+    line.stream().write(msg.data(), end == std::string::npos ? 0 : end + 1);
+  }
 }
 
 std::vector<std::string> split(const std::string &str, char separator)
@@ -59,44 +65,53 @@ std::vector<std::string> split(const std::string &str, char separator)
 
 bool is_empty(const uint8_t *arr, std::size_t size)
 {
-  uint8_t *zeros = new uint8_t[size](); // Allocate an array of size 'size' filled with zeros.
-  int result = memcmp(arr, zeros, size);
-  delete[] zeros;
-  return result == 0;
+  // All zeros when the first byte is zero and every byte equals the next one, stops at the first non-zero byte
+  return size == 0 || (arr[0] == 0 && memcmp(arr, arr + 1, size - 1) == 0);
 }
 
-unsigned int getbitu(const unsigned char *buff, int pos, int len)
+// CRC lookup tables, built once at startup
+struct CrcTables
 {
-  unsigned int bits = 0;
-  int i;
-  for (i = pos; i < pos + len; i++)
-    bits = (bits << 1) + ((buff[i / 8] >> (7 - i % 8)) & 1u);
-  return bits;
-}
+  uint32_t crc24q[256];
+  uint16_t crc16[256];
 
-
-std::vector<int> identifyRTCM3MessageIDs(const uint8_t *buffer, size_t bufferSize)
-{
-  size_t index = 0;
-  std::vector<int> res;
-  while (index < bufferSize)
+  CrcTables()
   {
-    if (bufferSize - index < 3)
+    for (uint32_t i = 0; i < 256; i++)
     {
-      std::cerr << "Invalid buffer size. Remaining bytes are not enough for an RTCM3 message." << std::endl;
-      break;
+      uint32_t crc = i << 16;
+      for (int j = 0; j < 8; j++)
+      {
+        crc <<= 1;
+        if (crc & 0x1000000)
+          crc ^= 0x1864CFB;
+      }
+      crc24q[i] = crc & 0xFFFFFF;
+
+      uint16_t crc16_value = i << 8;
+      for (int j = 0; j < 8; j++)
+        crc16_value = (crc16_value & 0x8000) ? (crc16_value << 1) ^ 0x1021 : (crc16_value << 1);
+      crc16[i] = crc16_value;
     }
+  }
+};
 
-    uint16_t id = getbitu(buffer + index, 24, 12);
-
-    res.push_back(id);
+static const CrcTables crc_tables;
 
-    // Calculate the length of the current RTCM3 message
-    uint16_t length = getbitu(buffer + index, 14, 10);
+uint32_t crc24q(const uint8_t *data, size_t size)
+{
+  uint32_t crc = 0;
+  for (size_t i = 0; i < size; i++)
+    crc = ((crc << 8) & 0xFFFFFF) ^ crc_tables.crc24q[(crc >> 16) ^ data[i]];
+  return crc;
+}
 
-    index += length + 6;
-  }
-  return res;
+uint16_t crc16_ccitt(const uint8_t *data, size_t size)
+{
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++)
+    crc = (crc << 8) ^ crc_tables.crc16[((crc >> 8) ^ data[i]) & 0xFF];
+  return crc;
 }
 
 float distanceBetweenLocations( float lat1 ,  float lon1 , float lat2 ,  float lon2)
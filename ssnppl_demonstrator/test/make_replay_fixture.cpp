@@ -0,0 +1,65 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+// Writes a short SPARTN replay (<prefix>_Ip.bin and <prefix>_Rcvr.bin) for the replay tests
+
+#include "spartn_log.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <replay prefix>" << std::endl;
+        return 1;
+    }
+    const std::string prefix = argv[1];
+    SpartnLogPolicy policy;
+    SpartnLogger ip, rcvr;
+    if (!ip.open(prefix + "_Ip", policy) || !rcvr.open(prefix + "_Rcvr", policy))
+    {
+        std::cerr << "cannot open " << prefix << std::endl;
+        return 1;
+    }
+
+    // SPARTN messages of growing size, each one with a receiver position
+    std::vector<uint8_t> spartn(1024, 0x73);
+    const std::string gga = "$GPGGA,120000.00,5050.0000,N,00440.0000,E,1,12,0.8,100.0,M,47.0,M,,*47\r\n";
+    for (int i = 0; i < 200; i++)
+    {
+        ip.log(spartn.data(), 300 + i);
+        rcvr.log((const uint8_t *)gga.data(), gga.size());
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "mqtt.hpp"
+#include "check.hpp"
+#include "fake_mosquitto.hpp"
+#include <string>
+
+static bool subscribed(const struct mosquitto &client, const std::string &topic)
+{
+    return client.subscriptions.count(topic) > 0;
+}
+
+/*  The dispatch thread of the demonstrator switching broker while the position moves to other tiles:
+    the new client only accepts subscriptions once connected, so everything changed meanwhile is
+    subscribed by mqtt_on_connect(), and what is replaced is unsubscribed from the previous client. */
+static void tile_change_during_switch()
+{
+    UserData user_data;
+    user_data.localized = true;
+    user_data.corrections_mode = "Ip";
+    const std::string node1 = "/pp/ip/L2/N5000E00400", node2 = "/pp/ip/L2/N4500E00400", node3 = "/pp/ip/L2/N4500E00450";
+    const std::string tile1 = "/pp/ip/L2dict/5000E00400", tile2 = "/pp/ip/L2dict/4500E00400", tile3 = "/pp/ip/L2dict/4500E00450";
+
+    // Client of the first broker, at the first position
+    struct mosquitto previous;
+    previous.connected = true;
+    mqtt_on_connect(&previous, &user_data, 0);
+    CHECK(mqtt_replace_topic(&user_data, &previous, nullptr, CURRENT_TILE, "", tile1, TOPIC_TILE));
+    CHECK(subscribed(previous, tile1));
+    // Dictionary received: mqtt_on_message() unsubscribes it, handle_tile_message() drops it
+    mosquitto_unsubscribe(&previous, NULL, tile1.c_str());
+    user_data.topics.drop_current(tile1);
+    CHECK(mqtt_replace_topic(&user_data, &previous, nullptr, CURRENT_NODE, "", node1, TOPIC_NODE));
+
+    // apply_tile(): the dictionary names another broker, its client connects asynchronously
+    struct mosquitto next;
+    user_data.topics.set_current(CURRENT_NODE, node2, TOPIC_NODE);
+
+    // The position moves on before the CONNACK: new tile, prefetched tile and warm node
+    CHECK(mqtt_replace_topic(&user_data, &next, &previous, CURRENT_TILE, tile1, tile2, TOPIC_TILE));
+    CHECK(mqtt_replace_topic(&user_data, &next, &previous, CURRENT_PREFETCH_TILE, "", tile3, TOPIC_TILE));
+    CHECK(mqtt_replace_topic(&user_data, &next, &previous, CURRENT_WARM_NODE, "", node3, TOPIC_NODE_WARM));
+    CHECK(next.subscriptions.empty());
+
+    next.connected = true;
+    mqtt_on_connect(&next, &user_data, 0);
+    CHECK_EQUAL(next.subscriptions.size(), 4u);
+    CHECK(subscribed(next, node2));
+    CHECK(subscribed(next, tile2));
+    CHECK(subscribed(next, tile3));
+    CHECK(subscribed(next, node3));
+    CHECK_EQUAL(user_data.topics.resolve(node2.c_str()), TOPIC_NODE);
+    CHECK_EQUAL(user_data.topics.resolve(tile2.c_str()), TOPIC_TILE);
+    CHECK_EQUAL(user_data.topics.resolve(tile3.c_str()), TOPIC_TILE);
+    CHECK_EQUAL(user_data.topics.resolve(node3.c_str()), TOPIC_NODE_WARM);
+    CHECK_EQUAL(user_data.topics.resolve(tile1.c_str()), TOPIC_NONE);
+
+    // The previous client keeps delivering the previous node until the switch completes
+    CHECK_EQUAL(previous.subscriptions.size(), 1u);
+    CHECK(subscribed(previous, node1));
+
+    // Once connected, a replaced topic leaves both clients
+    CHECK(mqtt_replace_topic(&user_data, &next, &previous, CURRENT_WARM_NODE, node3, "", TOPIC_NODE_WARM));
+    CHECK(!subscribed(next, node3));
+    CHECK_EQUAL(user_data.topics.resolve(node3.c_str()), TOPIC_NONE);
+    CHECK(mqtt_replace_topic(&user_data, &next, &previous, CURRENT_NODE, node2, node3, TOPIC_NODE));
+    CHECK(!subscribed(next, node2));
+    CHECK(subscribed(next, node3));
+    CHECK(subscribed(previous, node1));
+
+    // A reconnect of the new client subscribes what is current, not the received dictionaries
+    user_data.topics.drop_current(tile2);
+    next.subscriptions.clear();
+    mqtt_on_connect(&next, &user_data, 0);
+    CHECK_EQUAL(next.subscriptions.size(), 2u);
+    CHECK(subscribed(next, node3));
+    CHECK(subscribed(next, tile3));
+}
+
+int main()
+{
+    tile_change_during_switch();
+    return test_result();
+}
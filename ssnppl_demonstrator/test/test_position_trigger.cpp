@@ -0,0 +1,213 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "position_trigger.hpp"
+#include "node_index.hpp"
+#include "utils.hpp"
+#include "check.hpp"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/*  Tile and node churn of the localized service along simulated trajectories, one fix per second:
+    the PositionTrigger (distance, minimum interval and hysteresis) against recomputing on every fix. */
+
+#define SIM_TILE_SCALE 2.5f // degrees of a level 2 tile
+
+struct Fix {
+    float latitude, longitude;
+    double time;
+};
+
+struct Churn {
+    int recomputes = 0;
+    int tile_switches = 0;
+    int node_switches = 0;
+};
+
+static int tile_of(float latitude, float longitude)
+{
+    return (int)std::floor(latitude / SIM_TILE_SCALE) * 1000 + (int)std::floor(longitude / SIM_TILE_SCALE);
+}
+
+// As process_new_position() and new_Node_Topic(), without the trigger and the hysteresis when every_fix
+static Churn simulate(const std::vector<Fix> &fixes, const NodeIndex &nodes, PositionTrigger trigger, bool every_fix)
+{
+    Churn churn;
+    int tile = -1, node = -1;
+    float tile_latitude = 0, tile_longitude = 0;
+    for (const Fix &fix : fixes)
+    {
+        if (!every_fix && !trigger.update(fix.latitude, fix.longitude, fix.time))
+            continue;
+        churn.recomputes++;
+
+        int new_tile = tile_of(fix.latitude, fix.longitude);
+        if (tile >= 0 && new_tile != tile && !every_fix &&
+            trigger.keep_tile(fix.latitude, fix.longitude, tile_latitude, tile_longitude, SIM_TILE_SCALE))
+            new_tile = tile;
+        if (new_tile != tile)
+        {
+            if (tile >= 0)
+                churn.tile_switches++;
+            tile = new_tile;
+            tile_latitude = fix.latitude;
+            tile_longitude = fix.longitude;
+        }
+
+        int nearest = nodes.nearest(fix.latitude, fix.longitude);
+        if (node >= 0 && nearest != node && !every_fix)
+        {
+            float current_lat, current_lon, nearest_lat, nearest_lon;
+            nodes.position(node, current_lat, current_lon);
+            nodes.position(nearest, nearest_lat, nearest_lon);
+            if (trigger.keep_node(distanceBetweenLocations(fix.latitude, fix.longitude, current_lat, current_lon) * 1000,
+                                  distanceBetweenLocations(fix.latitude, fix.longitude, nearest_lat, nearest_lon) * 1000))
+                nearest = node;
+        }
+        if (node >= 0 && nearest != node)
+            churn.node_switches++;
+        node = nearest;
+    }
+    return churn;
+}
+
+static PositionTrigger make_trigger(float distance, float hysteresis = POSITION_HYSTERESIS, double min_interval = POSITION_MIN_INTERVAL)
+{
+    PositionTrigger trigger;
+    trigger.set_distance(distance);
+    trigger.set_hysteresis(hysteresis);
+    trigger.set_min_interval(min_interval);
+    return trigger;
+}
+
+static void report(const char *trajectory, const char *mode, const Churn &churn)
+{
+    std::printf("%-14s %-24s recomputes=%6d tile_switches=%3d node_switches=%5d\n",
+                trajectory, mode, churn.recomputes, churn.tile_switches, churn.node_switches);
+}
+
+static const float meters_per_degree = 111195;
+static const float meters_per_degree_lon = meters_per_degree * std::cos(50 * float(M_PI / 180));
+
+// Two hours east along the tile border at latitude 50, weaving +-300 m across it with 5 m GNSS noise
+static void border_drive(const NodeIndex &nodes, std::mt19937 &random)
+{
+    std::normal_distribution<float> noise(0, 5);
+    std::vector<Fix> fixes;
+    for (int i = 0; i < 7200; i++)
+        fixes.push_back({50.0f + (300 * std::sin(i / 60.0f) + noise(random)) / meters_per_degree,
+                         7.1f + 25.0f * i / meters_per_degree_lon, (double)i});
+
+    Churn every_fix = simulate(fixes, nodes, PositionTrigger(), true);
+    report("border drive", "every fix", every_fix);
+    CHECK(every_fix.tile_switches > 10);
+    for (float distance : {10000.0f, 500.0f, 50.0f})
+    {
+        Churn churn = simulate(fixes, nodes, make_trigger(distance), false);
+        report("border drive", ("--distance " + std::to_string((int)distance)).c_str(), churn);
+        CHECK(churn.tile_switches <= 1);
+        CHECK(churn.node_switches <= every_fix.node_switches);
+    }
+}
+
+// One hour parked halfway between four nodes, the noise alone changes the nearest one
+static void parked(const NodeIndex &nodes, std::mt19937 &random)
+{
+    std::normal_distribution<float> noise(0, 5);
+    std::vector<Fix> fixes;
+    for (int i = 0; i < 3600; i++)
+        fixes.push_back({49.75f + noise(random) / meters_per_degree, 7.25f + noise(random) / meters_per_degree_lon, (double)i});
+
+    Churn every_fix = simulate(fixes, nodes, PositionTrigger(), true);
+    report("parked", "every fix", every_fix);
+    CHECK(every_fix.node_switches > 100);
+
+    Churn churn = simulate(fixes, nodes, make_trigger(0), false);
+    report("parked", "--distance 0", churn);
+    CHECK_EQUAL(churn.node_switches, 0);
+    CHECK_EQUAL(churn.recomputes, 720);
+
+    // Without hysteresis the node flaps again, at most once per recomputation
+    Churn no_hysteresis = simulate(fixes, nodes, make_trigger(0, 0), false);
+    report("parked", "--hysteresis 0", no_hysteresis);
+    CHECK(no_hysteresis.node_switches > 10);
+}
+
+// Three hours north at 30 m/s across one tile border: no switch is missed, only delayed
+static void straight_north(const NodeIndex &nodes, std::mt19937 &random)
+{
+    std::normal_distribution<float> noise(0, 5);
+    std::vector<Fix> fixes;
+    for (int i = 0; i < 10800; i++)
+        fixes.push_back({48.6f + (30.0f * i + noise(random)) / meters_per_degree, 7.3f + noise(random) / meters_per_degree_lon, (double)i});
+
+    Churn every_fix = simulate(fixes, nodes, PositionTrigger(), true);
+    report("straight north", "every fix", every_fix);
+    CHECK_EQUAL(every_fix.tile_switches, 1);
+
+    Churn churn = simulate(fixes, nodes, make_trigger(500), false);
+    report("straight north", "--distance 500", churn);
+    CHECK_EQUAL(churn.tile_switches, 1);
+    CHECK_EQUAL(churn.node_switches, every_fix.node_switches);
+
+    // The minimum interval bounds the recomputations whatever the distance
+    Churn interval_5 = simulate(fixes, nodes, make_trigger(0), false);
+    report("straight north", "--recompute_interval 5", interval_5);
+    CHECK(interval_5.recomputes <= 10800 / 5 + 1);
+    Churn interval_1 = simulate(fixes, nodes, make_trigger(0, POSITION_HYSTERESIS, 1), false);
+    report("straight north", "--recompute_interval 1", interval_1);
+    CHECK(interval_1.recomputes > 10800 / 2);
+    CHECK_EQUAL(interval_1.node_switches, every_fix.node_switches);
+}
+
+int main()
+{
+    // Nodes every 0.5 degree, as the /dict of the tiles around
+    std::vector<std::string> names;
+    char name[32];
+    for (int latitude = 4500; latitude <= 5500; latitude += 50)
+        for (int longitude = 0; longitude <= 1500; longitude += 50)
+        {
+            std::snprintf(name, sizeof(name), "N%04dE%05d", latitude, longitude);
+            names.push_back(name);
+        }
+    NodeIndex nodes;
+    nodes.build(names);
+
+    std::mt19937 random(1);
+    border_drive(nodes, random);
+    parked(nodes, random);
+    straight_north(nodes, random);
+    return test_result();
+}
@@ -0,0 +1,169 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "queue.hpp"
+#include "check.hpp"
+#include <string>
+#include <thread>
+
+static bool push(SpscRing<int> &ring, int value)
+{
+    int *slot = ring.begin_push();
+    if (slot == nullptr)
+        return false;
+    *slot = value;
+    ring.end_push();
+    return true;
+}
+
+// A full ring in drop-oldest mode keeps the newest elements while the consumer is in the middle of a batch
+static void overflow_during_batch()
+{
+    SpscRing<int> ring(4, RING_DROP_OLDEST);
+    for (int i = 1; i <= 4; i++)
+        CHECK(push(ring, i));
+
+    int *first = ring.pop();
+    CHECK(first != nullptr && *first == 1);
+    for (int i = 5; i <= 10; i++)
+        CHECK(push(ring, i));
+
+    // The element handed to the consumer is untouched by the pushes
+    CHECK_EQUAL(*first, 1);
+    CHECK_EQUAL(ring.size(), 4u);
+    CHECK_EQUAL(ring.drops(), 5u);
+
+    for (int expected = 7; expected <= 10; expected++)
+    {
+        int *value = ring.pop();
+        CHECK(value != nullptr && *value == expected);
+    }
+    CHECK(ring.pop() == nullptr);
+}
+
+// Same after a batch that stopped before the ring was empty, without a final pop
+static void overflow_after_partial_batch()
+{
+    SpscRing<int> ring(8, RING_DROP_OLDEST);
+    for (int i = 1; i <= 13; i++)
+        push(ring, i);
+    for (int i = 0; i < 3; i++)
+        ring.pop();
+
+    for (int i = 14; i <= 19; i++)
+        CHECK(push(ring, i));
+    for (int expected = 12; expected <= 19; expected++)
+    {
+        int *value = ring.pop();
+        CHECK(value != nullptr && *value == expected);
+    }
+    CHECK(ring.pop() == nullptr);
+}
+
+// The buffers reserved by init circulate between the slots and the consumer
+static void buffers_are_reused()
+{
+    SpscRing<std::string> ring(2, RING_DROP_OLDEST, [](std::string &slot) { slot.reserve(256); });
+    for (int i = 0; i < 10; i++)
+    {
+        std::string *slot = ring.begin_push();
+        CHECK(slot != nullptr);
+        slot->assign(100, 'a' + i);
+        ring.end_push();
+
+        std::string *value = ring.pop();
+        CHECK(value != nullptr && (*value)[0] == 'a' + i && value->capacity() >= 256);
+    }
+}
+
+// Drop-oldest under contention: what is received stays in order and the last element always arrives
+static void concurrent_drop_oldest()
+{
+    const int count = 200000;
+    SpscRing<int> ring(16, RING_DROP_OLDEST);
+    std::thread producer([&ring] {
+        for (int i = 1; i <= count; i++)
+            push(ring, i);
+    });
+
+    int last = 0;
+    bool ordered = true;
+    while (last != count)
+    {
+        int *value = ring.pop();
+        if (value == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && *value > last;
+        last = *value;
+    }
+    producer.join();
+    CHECK(ordered);
+    CHECK_EQUAL(last, count);
+}
+
+// Blocking mode loses nothing
+static void concurrent_block()
+{
+    const int count = 200000;
+    SpscRing<int> ring(16, RING_BLOCK);
+    std::thread producer([&ring] {
+        for (int i = 1; i <= count; i++)
+            push(ring, i);
+    });
+
+    int expected = 1;
+    while (expected <= count)
+    {
+        int *value = ring.pop();
+        if (value == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        CHECK_EQUAL(*value, expected);
+        expected++;
+    }
+    producer.join();
+    CHECK_EQUAL(ring.drops(), 0u);
+}
+
+int main()
+{
+    overflow_during_batch();
+    overflow_after_partial_batch();
+    buffers_are_reused();
+    concurrent_drop_oldest();
+    concurrent_block();
+    return test_result();
+}
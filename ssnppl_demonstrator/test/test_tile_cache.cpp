@@ -0,0 +1,106 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "tile_cache.hpp"
+#include "check.hpp"
+#include <cstdio>
+#include <string>
+
+static std::shared_ptr<const TileDict> make_dict(const std::string &prefix, std::time_t received)
+{
+    std::shared_ptr<TileDict> dict = std::make_shared<TileDict>();
+    dict->nodeprefix = prefix;
+    dict->endpoint = "pp.services.u-blox.com";
+    dict->nodes.build({"N5000E00400", "N5025E00400", "N5000E00425"});
+    dict->received = received;
+    return dict;
+}
+
+// A TTL of 0 keeps the dictionaries whatever their age, in memory and in the file
+static void ttl_zero_never_expires(const std::string &path)
+{
+    std::remove(path.c_str());
+    {
+        TileCache cache;
+        cache.open(path, 4, 0);
+        cache.insert("old", make_dict("pp/ip/L2/", 1));
+        CHECK(cache.find("old") != nullptr);
+        CHECK_EQUAL(cache.expirations(), 0u);
+    }
+    TileCache cache;
+    CHECK_EQUAL(cache.open(path, 4, 0), 1u);
+    CHECK(cache.find("old") != nullptr);
+}
+
+// A positive TTL expires the old dictionaries and keeps the recent ones
+static void ttl_expires()
+{
+    TileCache cache;
+    cache.open("none", 4, 60);
+    cache.insert("old", make_dict("pp/ip/L2/", std::time(nullptr) - 61));
+    cache.insert("new", make_dict("pp/ip/L2/", std::time(nullptr)));
+    CHECK(cache.find("old") == nullptr);
+    CHECK(cache.find("new") != nullptr);
+    CHECK_EQUAL(cache.expirations(), 1u);
+}
+
+// close() writes the last snapshot, the file keeps the LRU order and the capacity
+static void close_writes_last_snapshot(const std::string &path)
+{
+    std::remove(path.c_str());
+    {
+        TileCache cache;
+        cache.open(path, 2, 3600);
+        std::time_t now = std::time(nullptr);
+        cache.insert("a", make_dict("a/", now));
+        cache.insert("b", make_dict("b/", now));
+        cache.insert("c", make_dict("c/", now));
+        CHECK_EQUAL(cache.evictions(), 1u);
+        cache.close();
+        CHECK_EQUAL(cache.write_errors(), 0u);
+    }
+    TileCache cache;
+    CHECK_EQUAL(cache.open(path, 2, 3600), 2u);
+    CHECK(cache.find("a") == nullptr);
+    std::shared_ptr<const TileDict> b = cache.find("b");
+    CHECK(b != nullptr && b->nodeprefix == "b/" && b->nodes.size() == 3);
+    CHECK(cache.find("c") != nullptr);
+}
+
+int main()
+{
+    const std::string path = "test_tile_cache.json";
+    ttl_zero_never_expires(path);
+    ttl_expires();
+    close_writes_last_snapshot(path);
+    std::remove(path.c_str());
+    return test_result();
+}
@@ -0,0 +1,98 @@
+// ****************************************************************************
+//
+// Copyright (c) 2023, Septentrio
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// ****************************************************************************
+
+#include "mqtt.hpp"
+#include "check.hpp"
+#include <string>
+#include <thread>
+
+// Without a current topic nothing is subscribed, otherwise the subscribed topics are bound with the ID of their slot
+static void bind_current_topic()
+{
+    TopicTable topics;
+    int subscribed = 0;
+    auto subscribe = [&](const std::string &, topic_id) { subscribed++; return true; };
+    CHECK_EQUAL(topics.bind_current(subscribe), 0u);
+    CHECK_EQUAL(subscribed, 0);
+
+    topics.set_current(CURRENT_NODE, "/pp/ip/L2/N5000E00400", TOPIC_NODE);
+    topics.set_current(CURRENT_TILE, "/pp/ip/L2dict/5000E00400", TOPIC_TILE);
+    topics.set_current(CURRENT_WARM_NODE, "/pp/ip/L2/N5025E00400", TOPIC_NODE_WARM);
+    CHECK_EQUAL(topics.bind_current(subscribe), 3u);
+    CHECK_EQUAL(subscribed, 3);
+    CHECK_EQUAL(topics.resolve("/pp/ip/L2/N5000E00400"), TOPIC_NODE);
+    CHECK_EQUAL(topics.resolve("/pp/ip/L2dict/5000E00400"), TOPIC_TILE);
+    CHECK_EQUAL(topics.resolve("/pp/ip/L2/N5025E00400"), TOPIC_NODE_WARM);
+
+    // A tile whose dictionary is received is not subscribed again
+    topics.drop_current("/pp/ip/L2dict/5000E00400");
+    subscribed = 0;
+    CHECK_EQUAL(topics.bind_current(subscribe), 2u);
+    CHECK_EQUAL(subscribed, 2);
+
+    // A failed subscription is not bound
+    TopicTable failing;
+    failing.set_current(CURRENT_NODE, "/pp/ip/L2/N5050E00400", TOPIC_NODE);
+    CHECK_EQUAL(failing.bind_current([](const std::string &, topic_id) { return false; }), 0u);
+    CHECK_EQUAL(failing.resolve("/pp/ip/L2/N5050E00400"), TOPIC_NONE);
+}
+
+/*  A client connecting while the dispatch thread moves to another node: whatever the interleaving,
+    once the dispatch thread has unbound the previous node only the new one is left bound. */
+static void node_switch_during_connect()
+{
+    for (int round = 0; round < 1000; round++)
+    {
+        TopicTable topics;
+        const std::string previous = "/pp/ip/L2/N5000E00400", next = "/pp/ip/L2/N5025E00400";
+        topics.set_current(CURRENT_NODE, previous, TOPIC_NODE);
+        topics.bind(previous, TOPIC_NODE);
+
+        std::thread connect([&] {
+            topics.bind_current([](const std::string &, topic_id) { return true; });
+        });
+        // mqtt_replace_topic(): the new topic is made current before the previous one is unbound
+        topics.set_current(CURRENT_NODE, next, TOPIC_NODE);
+        topics.unbind(previous);
+        topics.bind(next, TOPIC_NODE);
+        connect.join();
+
+        CHECK_EQUAL(topics.resolve(previous.c_str()), TOPIC_NONE);
+        CHECK_EQUAL(topics.resolve(next.c_str()), TOPIC_NODE);
+    }
+}
+
+int main()
+{
+    bind_current_topic();
+    node_switch_during_connect();
+    return test_result();
+}